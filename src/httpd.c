@@ -0,0 +1,2571 @@
+/**
+ *  @file   httpd.c
+ *  @brief  The web server library (libhttpd) that parses the HTTP request
+ *          from the browser, creates an HTTP response message consisting of
+ *          the requested file preceded by header lines, then sends the
+ *          response directly to the client
+ *  @author Seunghyun Kim
+ */
+
+/**
+ * sys/types.h:   definitions of a number of data types
+ *                used in socket.h and netinet/in.h
+ * sys/socket.h:  definitions of structures needed for sockets
+ * netinet/in.h:  constants and structures needed for internet domain addresses
+ */
+#define _FILE_OFFSET_BITS 64  /* 64-bit off_t for files beyond 2 GB*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/select.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#include "httpd.h"
+
+/* Success and error value*/
+#define SUCCESS_RESULT HTTPD_SUCCESS
+#define FAILURE_RESULT HTTPD_FAILURE
+
+/* Limit number*/
+#define MAX_LINE 255
+#define BUFFER_SIZE 4096
+/* Response sent when the response header does not fit in BUFFER_SIZE*/
+#define RESPONSE_TOO_LONG "HTTP/1.1 500 Internal Server Error\r\n" \
+                          "Content-Length: 0\r\nConnection: close\r\n\r\n"
+#define SENDFILE_CHUNK (1 << 30)  /* Bytes per sendfile() call*/
+#define LISTEN_BACKLOG 128  /* Connections waiting for accept()*/
+#define SMALL_RESPONSE_SIZE 65536 /* Bodies up to this size are interactive*/
+#define PRIORITY_INTERACTIVE 6  /* SO_PRIORITY of small responses*/
+#define PRIORITY_BULK 2 /* SO_PRIORITY of large responses*/
+#define BULK_RESPONSE_SIZE (1 << 20)  /* Bodies handed to a bulk transfer*/
+#define MAX_BULK_TRANSFERS 32 /* Bulk transfers running per worker*/
+
+/* File upload by POST multipart/form-data*/
+#define UPLOAD_DIR "upload" /* Directory the uploaded files are saved*/
+#define MAX_UPLOAD_SIZE (1LL << 30) /* Largest accepted request body*/
+#define MAX_BOUNDARY 70 /* Longest multipart boundary (RFC 2046)*/
+#define MULTIPART_WINDOW 65536  /* Bytes of the body parsed at once*/
+#define MAX_UPLOAD_FILES 16 /* File parts saved from one request*/
+#define UPLOAD_PATH_SIZE (sizeof(UPLOAD_DIR) + MAX_LINE + 1) /* {dir}/{name}*/
+#define DRAIN_LIMIT (1 << 20) /* Unread body bytes discarded before close*/
+#define DRAIN_TIMEOUT 1 /* Seconds to wait for each read while draining*/
+
+/** States of the multipart parser*/
+#define MULTIPART_PREAMBLE 0  /* Before the first boundary*/
+#define MULTIPART_HEADERS 1 /* In the header lines of a part*/
+#define MULTIPART_DATA 2  /* In the content of a part*/
+#define MULTIPART_DONE 3  /* After the close boundary*/
+
+/* Worker processes sharing the server socket*/
+#define WORKER_COUNT 4  /* Workers started with the server*/
+#define MIN_WORKERS 2
+#define MAX_WORKERS 16
+#define SUPERVISE_INTERVAL 1  /* Seconds between scaling decisions*/
+#define CPU_PRESSURE_HIGH 40.0  /* PSI cpu "some avg10" (%) to stop growing*/
+#define IO_PRESSURE_HIGH 20.0 /* PSI io "some avg10" (%) to stop growing*/
+#define IDLE_ROUNDS_TO_SHRINK 10  /* Idle intervals before removing a worker*/
+#define MEMORY_USAGE_HIGH 0.85  /* cgroup memory.current/memory.max to shrink*/
+#define MEMORY_PRESSURE_HIGH 10.0 /* PSI memory "some avg10" (%) to shrink*/
+#define LOAD_REPORT_ROUNDS 10 /* Intervals between worker load reports*/
+
+/* Request ID and W3C trace context*/
+#define TRACE_SAMPLE_RATE 64  /* Export 1 of every N new traces*/
+#define TRACE_SAMPLED 0x01  /* traceparent trace-flags "sampled" bit*/
+
+/** Index of MINE types*/
+#define File_t int
+#define UNKNOWN_FILE -1
+#define NO_FILE 0
+#define HTML_FILE 1
+#define GIF_FILE 2
+#define JPEG_FILE 3
+#define MP3_FILE 4
+#define PDF_FILE 5
+
+/** MINE types' content-type. {type)/{subtype}*/
+static char* Content_Types[] =  {"",
+                          "text/html",
+                          "image/gif",
+                          "image/jpeg",
+                          "audio/mpeg", /* mp3 or other MPEG media*/
+                          "application/pdf",};
+
+/** Precompressed variants of text files. {Content-Encoding} and file suffix*/
+#define ENCODING_COUNT 3
+static char* Content_Encodings[] = {"zstd", "br", "gzip"};
+static char* Encoding_Suffixes[] = {".zst", ".br", ".gz"};
+
+/** Set by SIGTERM. The worker exits after the current response*/
+static volatile sig_atomic_t worker_stopping = 0;
+static sigset_t accept_mask;  /** Signal mask of a worker waiting in accept*/
+static int spare_fd = -1; /** Descriptor given up to shed a connection*/
+
+/** Bulk transfer processes running for this worker*/
+static int bulk_transfers = 0;
+static pid_t bulk_pids[MAX_BULK_TRANSFERS]; /** Running bulk transfers*/
+
+static int worker_slot = -1; /** Slot of this worker in worker_loads*/
+
+static pid_t worker_id = 0; /** Process id of this worker, part of request ids*/
+static unsigned long request_sequence = 0; /** Requests served by this worker*/
+static unsigned long long trace_random = 0; /** State of NextTraceRandom()*/
+
+/**
+ *  @brief  The http response header line message. 
+ *          Struct contains "http_version" "code" "status" 
+ *          (eg. HTTP/1.1 200 OK)
+ */
+typedef struct http_response_line {
+  char* http_version; /** HTTP version*/
+  int code; /** response code*/
+  char* status; /** response status*/
+} http_response_line;
+
+/**
+ *  @brief  The response body send state.
+ *          Struct keeps the progress of a file transfer, so a short
+ *          read or a partial send is resumed from the next offset.
+ */
+typedef struct send_state {
+  int file_fd;  /** Descriptor of the file being sent*/
+  off_t offset; /** Next file offset to send*/
+  off_t file_size;  /** File size by fstat() when the request was opened*/
+} send_state;
+
+/**
+ *  @brief  The trace context of the current request.
+ *          Struct contains the request id and the W3C traceparent fields
+ *          (eg. 00-{trace_id}-{span_id}-01)
+ */
+typedef struct http_trace {
+  char request_id[MAX_LINE];  /** {worker pid}-{request number}*/
+  char trace_id[33];  /** 32 hex digits, shared by the whole trace*/
+  char parent_id[17]; /** Span id of the caller, empty if none*/
+  char span_id[17]; /** Span id of this request*/
+  int flags;  /** trace-flags*/
+  int code; /** Response status code*/
+  char name[MAX_LINE];  /** Span name {action} {location}*/
+  char traceparent[MAX_LINE];  /** traceparent of this request*/
+} http_trace;
+
+static http_trace current_trace; /** Trace context of the current request*/
+
+static void error(char *msg);
+static int SetupServerSocket(int portno);
+static int SuperviseWorkers(httpd_server* server);
+static int StopPoolWorker(pid_t workers[], int* worker_count,
+                          pid_t stopped_workers[]);
+static void ReapWorkers(pid_t workers[], int worker_count, int options);
+static int GetAcceptQueueLength(int server_socket);
+static double GetPressure(char* resource);
+static double GetMemoryUsage(void);
+static void ReportWorkerLoad(httpd_server* server, int worker_count,
+                            unsigned long last_loads[]);
+static pid_t StartWorker(httpd_server* server, int slot);
+static void StopWorker(int signal_number);
+static void RunWorker(httpd_server* server);
+static int AcceptClient(int server_socket, struct sockaddr_in* cli_addr,
+                        socklen_t* client_address_length);
+static int ListenRequest(int client_socket, char *buffer);
+static int ParseHTTPRequest(httpd_request_line* req_header_line,
+                            httpd_message request_body[], char *buffer);
+static int BuildResponse(httpd_server* server, int client_socket,
+                        httpd_request_line* req_header_line,
+                        httpd_message request_body[], int request_body_line,
+                        httpd_content* content, char *buffer);
+static int ReceiveUpload(int client_socket, int docroot_fd, char* http_version,
+                        httpd_message request_body[], int request_body_line,
+                        httpd_content* content);
+static int ReceiveMultipart(int client_socket, int docroot_fd,
+                            httpd_content* content, off_t content_length,
+                            char* boundary);
+static char* FindDelimiter(char* data, size_t length, char* delimiter,
+                          size_t delimiter_length);
+static int OpenPartFile(int docroot_fd, char* part_headers, char* part_path,
+                        int* part_fd);
+static int OpenRequestFile(int docroot_fd, char* filesrc,
+                          struct stat* file_stat);
+static int AcceptsEncoding(char* accept_encoding, char* encoding);
+static char* OpenEncodedFile(int docroot_fd, char* filesrc,
+                            char* accept_encoding, int* file_fd,
+                            struct stat* file_stat);
+static void MakeETag(struct stat* file_stat, char* etag);
+static ssize_t WriteAll(int client_socket, char* data, size_t length);
+static void DrainRequest(int client_socket);
+static void LogTCPInfo(int client_socket, struct timespec* start_time);
+static pid_t StartBulkTransfer(httpd_server* server, off_t body_size);
+static void StopBulkTransfers(void);
+static void SetSendPriority(int client_socket, off_t body_size);
+static void CorkSocket(int client_socket, int is_corked);
+static int ResponseHeader(int client_socket, char* http_version, int code,
+                          File_t filetype, char* filesrc, struct stat* file_stat,
+                          char* content_encoding, httpd_message headers[],
+                          int header_count, off_t body_length);
+static off_t ResponseBody(int client_socket, char* buffer, char* filesrc,
+                          File_t filetype, int file_fd, struct stat* file_stat);
+static off_t SendResponse(int client_socket, char* buffer, char* file_name,
+                          int file_fd, off_t file_size);
+static ssize_t SendFileChunk(int client_socket, char* buffer, send_state* state);
+static unsigned long long NextTraceRandom(void);
+static void EscapeJSON(char* dest, size_t dest_size, char* src);
+static void StartTrace(httpd_request_line* req_header_line,
+                      httpd_message request_body[], int request_body_line);
+static void ExportSpan(int trace_fd, struct timespec* start_time);
+
+/**
+ *  @brief  This creates a server listening on a port.
+ *          The document root is the current directory until HttpdMount()
+ *          changes it. No route is registered, uploads are accepted only
+ *          after HttpdRoute() with HttpdUploadHandler.
+ *  @param  portno  The port number
+ *  @return Return the server, or NULL if the port cannot be listened.
+ */
+httpd_server* HttpdCreate(int portno) {
+  httpd_server* server = malloc(sizeof(httpd_server));
+
+  if (server == NULL) {
+    return NULL;
+  }
+  memset(server, 0, sizeof(httpd_server));
+  server->docroot_fd = AT_FDCWD;
+  server->trace_fd = -1;
+
+  server->server_socket
+  = SetupServerSocket(portno);  /* make server socket with port number*/
+  if (server->server_socket < 0) {
+    free(server);
+    return NULL;
+  }
+
+  /* Listen for socket connections. Backlog queue is LISTEN_BACKLOG*/
+  if (listen(server->server_socket, LISTEN_BACKLOG) < 0) {
+    perror("[-] ERROR during listening on the server socket");
+    close(server->server_socket);
+    free(server);
+    return NULL;
+  }
+  /* A connection taken by another worker must not block accept()*/
+  fcntl(server->server_socket, F_SETFL,
+        fcntl(server->server_socket, F_GETFL) | O_NONBLOCK);
+  printf("\n[+] SUCCESS start server_socket.\n");
+
+  return server;
+}
+
+/**
+ *  @brief  This mounts a directory as the document root of the server.
+ *          Request locations and uploads are resolved under it.
+ *          The directory holds html/index.html and html/404.html.
+ *  @param  server  The server.
+ *  @param  docroot  The directory to serve.
+ *  @return Return 0 if successful.
+ */
+int HttpdMount(httpd_server* server, char* docroot) {
+  int mount_fd = open(docroot, O_RDONLY | O_DIRECTORY);
+
+  if (mount_fd < 0) { /* Not a directory*/
+    perror("[-] ERROR during mounting document root");
+    return FAILURE_RESULT;
+  }
+  if (server->docroot_fd != AT_FDCWD) {
+    close(server->docroot_fd);
+  }
+  server->docroot_fd = mount_fd;
+
+  printf("[+] SUCCESS mounting %s as document root.\n", docroot);
+  return SUCCESS_RESULT;
+}
+
+/**
+ *  @brief  This registers a handler for requests to a location.
+ *          A route is matched before the static files, by the exact
+ *          action and location. A later route replaces an earlier one
+ *          with the same action and location.
+ *  @param  server  The server.
+ *  @param  action  The request method. (eg. POST)
+ *  @param  location  The request location. (eg. /upload)
+ *  @param  handler  The handler sending the whole response.
+ *  @param  arg  The pointer passed to the handler. (eg. program state)
+ *  @return Return 0 if successful.
+ */
+int HttpdRoute(httpd_server* server, char* action, char* location,
+              httpd_handler handler, void* arg) {
+  int i;
+
+  for (i = 0; i < server->route_count; i++) {
+    if (strcmp(server->routes[i].action, action) == 0 &&
+        strcmp(server->routes[i].location, location) == 0) {
+      server->routes[i].handler = handler;
+      server->routes[i].arg = arg;
+      return SUCCESS_RESULT;
+    }
+  }
+  if (server->route_count == HTTPD_MAX_ROUTES) { /* Route table is full*/
+    return FAILURE_RESULT;
+  }
+
+  server->routes[server->route_count].action = action;
+  server->routes[server->route_count].location = location;
+  server->routes[server->route_count].handler = handler;
+  server->routes[server->route_count].arg = arg;
+  server->route_count++;
+  return SUCCESS_RESULT;
+}
+
+/**
+ *  @brief  This runs the server until HttpdStop() is called.
+ *          The worker processes are forked and supervised in the caller's
+ *          process, and stopped before returning. Only the worker
+ *          processes are waited for, other children of the caller are left
+ *          to the caller.
+ *  @param  server  The server.
+ *  @return Return 0 if stopped by HttpdStop(), -1 if the workers cannot
+ *          be started.
+ */
+int HttpdRun(httpd_server* server) {
+  server->stopping = 0;
+  return SuperviseWorkers(server);
+}
+
+/**
+ *  @brief  This asks HttpdRun() to stop the workers and return.
+ *          It only sets a flag, so it is safe in a signal handler.
+ *  @param  server  The server.
+ *  @return Return nothing
+ */
+void HttpdStop(httpd_server* server) {
+  server->stopping = 1;
+}
+
+/**
+ *  @brief  This closes the server and releases its resources.
+ *  @param  server  The server.
+ *  @return Return nothing
+ */
+void HttpdDestroy(httpd_server* server) {
+  close(server->server_socket);  /* Finish server socket*/
+  printf("[+] SUCCESS closing the server socket.\n");
+
+  if (server->docroot_fd != AT_FDCWD) {
+    close(server->docroot_fd);
+  }
+  if (server->trace_fd >= 0) {
+    close(server->trace_fd);
+  }
+  free(server);
+}
+
+/**
+ *  @brief  This starts the workers and keeps their number fitted to load.
+ *          The workers are forked after listen(), so every worker accepts
+ *          from the same server socket and the kernel page cache holds one
+ *          copy of each file for all of them.
+ *          Every SUPERVISE_INTERVAL seconds:
+ *          1)  A worker that exited unexpectedly is restarted.
+ *          2)  If connections wait in the accept queue and neither the CPU
+ *              nor the disk I/O is under pressure, one worker is added
+ *              (up to MAX_WORKERS). Workers waiting on a busy disk are not
+ *              helped by more workers reading from it.
+ *          3)  If the CPU is under pressure or the queue stayed empty for
+ *              IDLE_ROUNDS_TO_SHRINK intervals, one worker is stopped
+ *              (down to MIN_WORKERS).
+ *          Memory is checked before CPU: with memory other than the page
+ *          cache near the cgroup memory.max, or under memory pressure, the
+ *          pool never grows and sheds a worker, so the container is not
+ *          OOM-killed.
+ *          When the server is stopped, every worker gets SIGTERM and is
+ *          waited for.
+ *  @param  server  The server.
+ *  @return Return 0 if stopped, -1 if the workers cannot be started.
+ */
+static int SuperviseWorkers(httpd_server* server) {
+  pid_t workers[MAX_WORKERS], /** Process ids of workers, -1 to restart*/
+        stopped_workers[MAX_WORKERS]; /** Workers sent SIGTERM, -1 if reaped*/
+  int worker_count = 0, /** Number of running workers*/
+      worker_status,  /** Exit status of a worker*/
+      queue_length, /** Connections waiting for accept()*/
+      idle_rounds = 0,  /** Intervals without waiting connections*/
+      rounds = 0, /** Supervise intervals so far*/
+      i;
+  unsigned long last_loads[MAX_WORKERS] = {0}; /** Loads at the last report*/
+  double cpu_pressure,  /** Percent of time runnable tasks waited for CPU*/
+        io_pressure,  /** Percent of time tasks waited for disk I/O*/
+        memory_pressure,  /** Percent of time tasks waited for memory*/
+        memory_usage; /** Ratio of cgroup memory in use*/
+
+  /* Request counters the workers update and the supervisor reports*/
+  server->worker_loads = mmap(NULL, sizeof(unsigned long) * MAX_WORKERS,
+                              PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (server->worker_loads == MAP_FAILED) {
+    perror("[-] ERROR during mapping worker loads");
+    server->worker_loads = NULL;
+    return FAILURE_RESULT;
+  }
+  for (i = 0; i < MAX_WORKERS; i++) {
+    stopped_workers[i] = -1;
+  }
+
+  for (i = 0; i < WORKER_COUNT; i++) {
+    workers[worker_count] = StartWorker(server, worker_count);
+    if (workers[worker_count] < 0) {  /* Cannot fork any worker*/
+      break;
+    }
+    worker_count++;
+  }
+  if (worker_count == 0) {
+    server->stopping = 1;
+  }
+
+  while (!server->stopping) {
+    sleep(SUPERVISE_INTERVAL);  /* A signal ends the sleep early*/
+    if (server->stopping) {
+      break;
+    }
+
+    /* Reap the stopped workers*/
+    ReapWorkers(stopped_workers, MAX_WORKERS, WNOHANG);
+
+    /* Restart the workers that exited unexpectedly*/
+    for (i = 0; i < worker_count; i++) {
+      if (workers[i] > 0 &&
+          waitpid(workers[i], &worker_status, WNOHANG) == workers[i]) {
+        printf("[*] WORKER %d exited (status %d), restarting.\n",
+              (int) workers[i], worker_status);
+        workers[i] = -1;
+      }
+      if (workers[i] < 0) { /* Fork failed before, try again*/
+        workers[i] = StartWorker(server, i);
+      }
+    }
+
+    if (++rounds % LOAD_REPORT_ROUNDS == 0) { /* Before the pool changes*/
+      ReportWorkerLoad(server, worker_count, last_loads);
+    }
+
+    queue_length = GetAcceptQueueLength(server->server_socket);
+    cpu_pressure = GetPressure("cpu");
+    io_pressure = GetPressure("io");
+    memory_pressure = GetPressure("memory");
+    memory_usage = GetMemoryUsage();
+    idle_rounds = (queue_length > 0) ? 0 : idle_rounds + 1;
+
+    if (memory_usage >= MEMORY_USAGE_HIGH ||
+        memory_pressure >= MEMORY_PRESSURE_HIGH) { /* Close to OOM*/
+      if (worker_count > MIN_WORKERS &&
+          StopPoolWorker(workers, &worker_count, stopped_workers)) {
+        printf("[*] WORKER pool shrinks to %d (memory %.0f%%, pressure %.1f%%)\n",
+              worker_count, memory_usage * 100, memory_pressure);
+      }
+    } else if (queue_length > 0 && cpu_pressure < CPU_PRESSURE_HIGH &&
+        io_pressure < IO_PRESSURE_HIGH && worker_count < MAX_WORKERS &&
+        (workers[worker_count] = StartWorker(server, worker_count)) > 0) {
+      /* Workers are saturated*/
+      worker_count++;
+      printf("[*] WORKER pool grows to %d (queue %d, cpu pressure %.1f%%)\n",
+            worker_count, queue_length, cpu_pressure);
+    } else if ((cpu_pressure >= CPU_PRESSURE_HIGH ||
+                idle_rounds >= IDLE_ROUNDS_TO_SHRINK) &&
+              worker_count > MIN_WORKERS &&
+              StopPoolWorker(workers, &worker_count, stopped_workers)) {
+      /* Workers are contended or idle*/
+      idle_rounds = 0;
+      printf("[*] WORKER pool shrinks to %d (queue %d, cpu pressure %.1f%%)\n",
+            worker_count, queue_length, cpu_pressure);
+    }
+    fflush(stdout);
+  }
+
+  /* Stop every worker after its current response*/
+  for (i = 0; i < worker_count; i++) {
+    if (workers[i] > 0) {
+      kill(workers[i], SIGTERM);
+    }
+  }
+  ReapWorkers(workers, worker_count, 0);
+  ReapWorkers(stopped_workers, MAX_WORKERS, 0);
+  munmap((void*) server->worker_loads, sizeof(unsigned long) * MAX_WORKERS);
+  server->worker_loads = NULL;
+
+  if (worker_count == 0) {
+    printf("[-] ERROR no worker could be started.\n");
+    return FAILURE_RESULT;
+  }
+  printf("[+] SUCCESS stopping the workers.\n");
+  return SUCCESS_RESULT;
+}
+
+/**
+ *  @brief  This sends SIGTERM to the last worker of the pool.
+ *          The worker is remembered in stopped_workers until it is reaped.
+ *  @param  workers  Process ids of the pool.
+ *  @param  worker_count  The number of workers, decreased by one.
+ *  @param  stopped_workers  Workers sent SIGTERM. (MAX_WORKERS slots)
+ *  @return Return 1 if a worker was stopped, 0 if the previous ones have
+ *          not exited yet.
+ */
+static int StopPoolWorker(pid_t workers[], int* worker_count,
+                          pid_t stopped_workers[]) {
+  int i;
+
+  for (i = 0; i < MAX_WORKERS; i++) {
+    if (stopped_workers[i] < 0) {
+      break;
+    }
+  }
+  if (i == MAX_WORKERS) { /* Too many workers still stopping*/
+    return 0;
+  }
+
+  (*worker_count)--;
+  stopped_workers[i] = workers[*worker_count];
+  if (stopped_workers[i] > 0) {
+    kill(stopped_workers[i], SIGTERM);
+  }
+  return 1;
+}
+
+/**
+ *  @brief  This waits for the given worker processes.
+ *          Only these pids are waited for, never other children of the
+ *          process embedding the server.
+ *  @param  workers  Process ids, a reaped one is set to -1.
+ *  @param  worker_count  The number of process ids.
+ *  @param  options  0 to block until each exits, WNOHANG to only reap.
+ *  @return Return nothing
+ */
+static void ReapWorkers(pid_t workers[], int worker_count, int options) {
+  pid_t reaped_pid;
+  int worker_status,
+      i;
+
+  for (i = 0; i < worker_count; i++) {
+    if (workers[i] <= 0) {
+      continue;
+    }
+    do {
+      reaped_pid = waitpid(workers[i], &worker_status, options);
+    } while (reaped_pid < 0 && errno == EINTR);
+    if (reaped_pid != 0) {  /* Exited, or not our child any more*/
+      workers[i] = -1;
+    }
+  }
+}
+
+/**
+ *  @brief  This reports how evenly requests spread over the workers.
+ *          Requests served by each running worker since the last report
+ *          are printed with their mean and variance.
+ *  @param  server  The server.
+ *  @param  worker_count  Number of running workers.
+ *  @param  last_loads  Loads at the last report. Updated to the current.
+ *  @return Return nothing
+ */
+static void ReportWorkerLoad(httpd_server* server, int worker_count,
+                            unsigned long last_loads[]) {
+  unsigned long loads[MAX_WORKERS], /** Requests since the last report*/
+                total = 0;
+  double mean,
+        variance = 0;
+  int i;
+
+  for (i = 0; i < worker_count; i++) {
+    loads[i] = server->worker_loads[i] - last_loads[i];
+    last_loads[i] = server->worker_loads[i];
+    total += loads[i];
+  }
+  for (; i < MAX_WORKERS; i++) { /* Stopped slots start over when reused*/
+    last_loads[i] = server->worker_loads[i];
+  }
+  if (total == 0) { /* Nothing to report*/
+    return;
+  }
+
+  mean = (double) total / worker_count;
+  printf("[*] WORKER load:");
+  for (i = 0; i < worker_count; i++) {
+    printf(" %lu", loads[i]);
+    variance += (loads[i] - mean) * (loads[i] - mean);
+  }
+  variance /= worker_count;
+  printf(" (mean %.1f, variance %.1f)\n", mean, variance);
+}
+
+/**
+ *  @brief  This gets the number of connections waiting for accept().
+ *  @param  server_socket  The listening server socket.
+ *  @return Return the accept queue length, or 0 if it is unknown.
+ */
+static int GetAcceptQueueLength(int server_socket) {
+#ifdef __linux__
+  struct tcp_info info;
+  socklen_t info_length = sizeof(info);
+
+  /* For a listening socket, tcpi_unacked is the accept queue length*/
+  if (getsockopt(server_socket, IPPROTO_TCP, TCP_INFO,
+                &info, &info_length) == 0) {
+    return (int) info.tcpi_unacked;
+  }
+#endif
+  return 0;
+}
+
+/**
+ *  @brief  This reads a resource pressure from Linux PSI.
+ *          (/proc/pressure/{resource}, "some avg10=")
+ *  @param  resource  The PSI resource. "cpu", "memory" or "io"
+ *  @return Return the percent of time tasks waited for the resource in the
+ *          last 10 seconds, or 0 if PSI is not available.
+ */
+static double GetPressure(char* resource) {
+  FILE *pressure_file;
+  char pressure_path[MAX_LINE];
+  double pressure = 0;
+
+  snprintf(pressure_path, MAX_LINE, "/proc/pressure/%s", resource);
+  pressure_file = fopen(pressure_path, "r");
+  if (pressure_file == NULL) {  /* Kernel without PSI*/
+    return 0;
+  }
+  if (fscanf(pressure_file, "some avg10=%lf", &pressure) != 1) {
+    pressure = 0;
+  }
+  fclose(pressure_file);
+
+  return pressure;
+}
+
+/**
+ *  @brief  This reads the memory usage of the server's cgroup v2.
+ *          The cgroup is found by the "0::" line of /proc/self/cgroup.
+ *          The page cache ("file" in memory.stat) is not counted: a file
+ *          server keeps memory.current near memory.max with cached files
+ *          the kernel can reclaim at any time. Real shortage shows in the
+ *          memory PSI instead.
+ *  @return Return (memory.current - file) / memory.max, or 0 if the cgroup
+ *          has no memory limit or cgroup v2 is not available.
+ */
+static double GetMemoryUsage(void) {
+  FILE *cgroup_file;
+  char  line[BUFFER_SIZE],
+        cgroup_path[BUFFER_SIZE],
+        limit[MAX_LINE];
+  unsigned long long memory_max = 0,
+                    memory_current = 0,
+                    memory_file = 0;  /** Page cache of the cgroup*/
+
+  /* Find the cgroup v2 path of this process*/
+  cgroup_file = fopen("/proc/self/cgroup", "r");
+  if (cgroup_file == NULL) {
+    return 0;
+  }
+  cgroup_path[0] = '\0';
+  while (fgets(line, BUFFER_SIZE, cgroup_file) != NULL) {
+    if (strncmp(line, "0::", 3) == 0) {
+      line[strcspn(line, "\n")] = '\0';
+      if (snprintf(cgroup_path, BUFFER_SIZE, "/sys/fs/cgroup%s",
+                  line + 3) >= BUFFER_SIZE - 16) {  /* No room for a file*/
+        cgroup_path[0] = '\0';
+      }
+      break;
+    }
+  }
+  fclose(cgroup_file);
+  if (cgroup_path[0] == '\0') { /* cgroup v1 only*/
+    return 0;
+  }
+
+  /* memory.max is "max" when the cgroup has no limit*/
+  if (snprintf(line, BUFFER_SIZE, "%s/memory.max", cgroup_path) >= BUFFER_SIZE) {
+    return 0;
+  }
+  cgroup_file = fopen(line, "r");
+  if (cgroup_file == NULL) {
+    return 0;
+  }
+  if (fscanf(cgroup_file, "%254s", limit) == 1) {
+    memory_max = strtoull(limit, NULL, 10);
+  }
+  fclose(cgroup_file);
+  if (memory_max == 0) {  /* No memory limit*/
+    return 0;
+  }
+
+  if (snprintf(line, BUFFER_SIZE, "%s/memory.current",
+              cgroup_path) >= BUFFER_SIZE) {
+    return 0;
+  }
+  cgroup_file = fopen(line, "r");
+  if (cgroup_file == NULL) {
+    return 0;
+  }
+  if (fscanf(cgroup_file, "%llu", &memory_current) != 1) {
+    memory_current = 0;
+  }
+  fclose(cgroup_file);
+
+  /* "file {bytes}" line of memory.stat*/
+  if (snprintf(line, BUFFER_SIZE, "%s/memory.stat", cgroup_path) >= BUFFER_SIZE) {
+    return 0;
+  }
+  cgroup_file = fopen(line, "r");
+  if (cgroup_file == NULL) {
+    return 0;
+  }
+  while (fgets(line, BUFFER_SIZE, cgroup_file) != NULL) {
+    if (sscanf(line, "file %llu", &memory_file) == 1) {
+      break;
+    }
+  }
+  fclose(cgroup_file);
+
+  if (memory_file > memory_current) {
+    memory_file = memory_current;
+  }
+  return (double) (memory_current - memory_file) / memory_max;
+}
+
+/**
+ *  @brief  This forks a worker process serving the server socket.
+ *  @param  server  The server.
+ *  @param  slot  The slot of the worker in worker_loads.
+ *  @return Return process id of the worker, or -1 if fork() failed.
+ */
+static pid_t StartWorker(httpd_server* server, int slot) {
+  pid_t worker_pid;
+
+  fflush(stdout); /* Do not copy buffered logs into the worker*/
+  worker_pid = fork();
+
+  if (worker_pid < 0) { /* Failed to fork, the supervisor retries*/
+    perror("[-] ERROR during starting worker process");
+    return -1;
+  } else if (worker_pid == 0) { /* Worker process*/
+    struct sigaction stop_action;
+    struct timespec seed_time;
+
+    /*
+     *  SIGTERM from the supervisor stops the worker between requests.
+     *  It is blocked while a request is served and delivered only in
+     *  AcceptClient(), so no system call of a request sees EINTR.
+     */
+    memset(&stop_action, 0, sizeof(stop_action));
+    stop_action.sa_handler = StopWorker;
+    sigaction(SIGTERM, &stop_action, NULL);
+    signal(SIGINT, SIG_IGN);  /* Ctrl-C stops the supervisor, not workers*/
+    signal(SIGPIPE, SIG_IGN); /* A closed client is EPIPE, not a killed worker*/
+    sigemptyset(&stop_action.sa_mask);
+    sigaddset(&stop_action.sa_mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &stop_action.sa_mask, &accept_mask);
+    sigdelset(&accept_mask, SIGTERM);
+
+    worker_slot = slot;
+    spare_fd = open("/dev/null", O_RDONLY);  /* Kept for AcceptClient()*/
+    worker_id = getpid();  /* Request ids need no syscall after this*/
+    clock_gettime(CLOCK_MONOTONIC, &seed_time);
+    trace_random = ((unsigned long long) worker_id << 32) ^
+                  (unsigned long long) time(NULL) ^
+                  (unsigned long long) seed_time.tv_nsec;
+    RunWorker(server);
+    StopBulkTransfers();
+    fflush(stdout);
+    _exit(0); /* Never run the atexit() handlers of the embedding program*/
+  }
+
+  printf("[+] SUCCESS starting worker %d.\n", (int) worker_pid);
+  return worker_pid;
+}
+
+/**
+ *  @brief  This is SIGTERM handler of a worker process.
+ *  @param  signal_number  The received signal.
+ *  @return Return nothing
+ */
+static void StopWorker(int signal_number) {
+  worker_stopping = 1;
+}
+
+/**
+ *  @brief  This is the request loop of a worker process.
+ *          Accept a client, read the request, and send the response.
+ *  @param  server  The server.
+ *  @return Return nothing
+ */
+static void RunWorker(httpd_server* server) {
+  int client_socket,  /** Descriptors return from accept()*/
+      request_bytes,  /** Bytes of the request message*/
+      request_body_line; /** Number of request body lines*/
+
+  socklen_t client_address_length;  /** Length of client-socket address*/
+  struct sockaddr_in cli_addr;  /** The client socket address*/
+
+  httpd_request_line req_header_line;   /** The request header message*/
+  httpd_message request_body[MAX_LINE]; /** The request body message*/
+  httpd_content content; /** Message body read with the header*/
+  struct timespec start_time; /** When the request was read*/
+
+  char  input_buffer[BUFFER_SIZE],
+        output_buffer[BUFFER_SIZE];
+
+  client_address_length = sizeof(cli_addr);
+
+  while(!worker_stopping) {
+    /* Get request from the client*/
+    client_socket = AcceptClient(server->server_socket, &cli_addr,
+                                &client_address_length);
+    if (client_socket < 0) {  /* Stopped while waiting for a client*/
+      break;
+    }
+
+
+    memset(input_buffer, 0x00, BUFFER_SIZE);
+    memset(output_buffer, 0x00, BUFFER_SIZE);
+
+    /* Get request from the client*/
+    request_bytes = ListenRequest(client_socket, input_buffer);
+    if (request_bytes <= 0) { /* Closed or failed before a request*/
+      close(client_socket);
+      continue;
+    } else {
+      printf("[+] SUCCESS reading request from client.\n");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+    /* Separate the message body read with the header*/
+    content.data = strstr(input_buffer, "\r\n\r\n");
+    if (content.data != NULL) {
+      content.data += 4;
+      content.length = input_buffer + request_bytes - content.data;
+      content.data[-1] = '\0'; /* Header parsing stops here*/
+    } else {
+      content.length = 0;
+    }
+
+    printf("*******************new******************\n");
+    
+    /* Parse request message to variables*/
+    request_body_line = ParseHTTPRequest(&req_header_line, request_body, input_buffer);
+    if (request_body_line < 0) {
+      error("[-] ERROR request_body_line is invalid.");
+    } else {
+      printf("[+] SUCCESS getting request body lines.\n");
+    }
+    StartTrace(&req_header_line, request_body, request_body_line);
+
+    /* Build response by request and send the response message*/
+    if (BuildResponse(server, client_socket, &req_header_line, request_body,
+                      request_body_line, &content, output_buffer) != SUCCESS_RESULT) {
+      /* The client is gone, only this connection ends*/
+      printf("[-] ERROR during building response.\n"); /* Fail response*/
+    } else {
+      printf("[+] SUCCESS finishing the connection...\n");  /* Success response*/
+    }
+    ExportSpan(server->trace_fd, &start_time);
+
+    close(client_socket);  /* Finish client socket*/
+    printf("[+] SUCCESS closing the client socket.\n");
+    if (server->worker_loads != NULL) {
+      server->worker_loads[worker_slot]++;
+    }
+  }
+}
+
+/**
+ *  @brief  This is error handler function.
+ *          Print the error message and exit process.
+ *  @param msg The string of the error message
+ *  @return  Return nothing
+ */
+static void error(char *msg) {
+  perror(msg);
+  fflush(stdout);
+  _exit(1); /* Only worker processes get here, skip the host's atexit()*/
+}
+
+/**
+ *  @brief  This opens the span export file of the server.
+ *          Sampled requests are appended to the file as one JSON line
+ *          per span, so a slow request can be followed across services
+ *          sharing its traceparent.
+ *  @param  server  The server.
+ *  @param  trace_path  The span export file.
+ *  @return Return 0 if successful.
+ */
+int HttpdTrace(httpd_server* server, char* trace_path) {
+  int trace_fd;
+
+  trace_fd = open(trace_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+  if (trace_fd < 0) { /* Tracing is optional, keep serving*/
+    perror("[-] ERROR during opening span export file");
+    return FAILURE_RESULT;
+  }
+  if (server->trace_fd >= 0) {
+    close(server->trace_fd);
+  }
+  server->trace_fd = trace_fd;
+
+  printf("[+] SUCCESS exporting sampled spans to %s\n", trace_path);
+  return SUCCESS_RESULT;
+}
+
+/**
+ *  @brief  This returns the trace context of the request being handled,
+ *          to be sent on with the requests a handler makes to upstreams.
+ *  @return Return the traceparent header value. (eg. 00-{trace_id}-{span_id}-01)
+ */
+char* HttpdTraceParent(void) {
+  return current_trace.traceparent;
+}
+
+/**
+ *  @brief  This returns the next number of the worker's splitmix64 generator.
+ *          Trace and span ids come from it without a syscall. Every output
+ *          is fully mixed, so workers seeded with close pids and times
+ *          still get unrelated ids.
+ *  @return Return 64 random bits.
+ */
+static unsigned long long NextTraceRandom(void) {
+  unsigned long long random_bits;
+
+  trace_random += 0x9E3779B97F4A7C15ULL;
+  random_bits = trace_random;
+  random_bits = (random_bits ^ (random_bits >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  random_bits = (random_bits ^ (random_bits >> 27)) * 0x94D049BB133111EBULL;
+  return random_bits ^ (random_bits >> 31);
+}
+
+/**
+ *  @brief  This copies a string into a JSON string literal.
+ *          '"', '\' and control characters are escaped, so a request
+ *          line cannot break or add fields to the span line. Bytes past
+ *          ASCII are escaped one by one, so the line stays valid UTF-8.
+ *  @param  dest  The buffer to write. (without the quotes)
+ *  @param  dest_size  Size of dest, 6 bytes per source byte is enough.
+ *  @param  src  The string to escape.
+ *  @return Return nothing
+ */
+static void EscapeJSON(char* dest, size_t dest_size, char* src) {
+  size_t length = 0;
+
+  for (; *src != '\0' && length + 7 <= dest_size; src++) {
+    if (*src == '"' || *src == '\\') {
+      dest[length++] = '\\';
+      dest[length++] = *src;
+    } else if ((unsigned char) *src < 0x20 || (unsigned char) *src >= 0x7f) {
+      length += sprintf(dest + length, "\\u%04x", (unsigned char) *src);
+    } else {
+      dest[length++] = *src;
+    }
+  }
+  dest[length] = '\0';
+}
+
+/**
+ *  @brief  This sets up the trace context of a new request.
+ *          The request id is the worker pid and the worker's request
+ *          number. A valid W3C traceparent header continues its trace,
+ *          otherwise a new trace is started and sampled 1/TRACE_SAMPLE_RATE.
+ *  @param  req_header_line  The request header pointer.
+ *  @param  request_body  The parsed request body.
+ *  @param  request_body_line  The number of request body lines.
+ *  @return Return nothing
+ */
+static void StartTrace(httpd_request_line* req_header_line,
+                      httpd_message request_body[], int request_body_line) {
+  char* traceparent;
+  int flags;
+
+  memset(&current_trace, 0, sizeof(current_trace));
+  request_sequence++;
+  snprintf(current_trace.request_id, MAX_LINE, "%x-%lu",
+          (unsigned int) worker_id, request_sequence);
+  snprintf(current_trace.name, MAX_LINE, "%s %s",
+          req_header_line->action, req_header_line->location);
+
+  /* version "00": 00-{32 hex trace-id}-{16 hex parent-id}-{2 hex flags}*/
+  traceparent = HttpdGetHeader(request_body, request_body_line, "traceparent");
+  if (traceparent != NULL && strlen(traceparent) == 55 &&
+      strncmp(traceparent, "00-", 3) == 0 &&
+      strspn(traceparent + 3, "0123456789abcdef") == 32 &&
+      traceparent[35] == '-' &&
+      strspn(traceparent + 36, "0123456789abcdef") == 16 &&
+      traceparent[52] == '-' &&
+      strspn(traceparent + 53, "0123456789abcdef") == 2 &&
+      strspn(traceparent + 3, "0") < 32 &&  /* All zero ids are invalid*/
+      strspn(traceparent + 36, "0") < 16) {
+    memcpy(current_trace.trace_id, traceparent + 3, 32);
+    memcpy(current_trace.parent_id, traceparent + 36, 16);
+    sscanf(traceparent + 53, "%2x", &flags);
+    current_trace.flags = flags;
+  } else {  /* Missing or invalid, start a new trace*/
+    snprintf(current_trace.trace_id, sizeof(current_trace.trace_id),
+            "%016llx%016llx", NextTraceRandom(), NextTraceRandom());
+    current_trace.flags
+    = (NextTraceRandom() % TRACE_SAMPLE_RATE == 0) ? TRACE_SAMPLED : 0;
+  }
+
+  snprintf(current_trace.span_id, sizeof(current_trace.span_id),
+          "%016llx", NextTraceRandom() | 1ULL);  /* Never all zero*/
+  snprintf(current_trace.traceparent, MAX_LINE, "00-%s-%s-%02x",
+          current_trace.trace_id, current_trace.span_id, current_trace.flags);
+}
+
+/**
+ *  @brief  This appends the span of a sampled request to the span
+ *          export file by one write().
+ *  @param  trace_fd  The span export file descriptor, or -1 if disabled.
+ *  @param  start_time  When the request was read. (CLOCK_MONOTONIC)
+ *  @return Return nothing
+ */
+static void ExportSpan(int trace_fd, struct timespec* start_time) {
+  char  span[BUFFER_SIZE], /** The span as a JSON line*/
+        name[MAX_LINE * 6]; /** Span name escaped for JSON*/
+  struct timespec end_time, wall_time;
+  long long duration_us;
+  int span_bytes;
+
+  if (trace_fd < 0 || !(current_trace.flags & TRACE_SAMPLED)) {
+    return;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end_time);
+  clock_gettime(CLOCK_REALTIME, &wall_time);
+  duration_us = (end_time.tv_sec - start_time->tv_sec) * 1000000LL +
+                (end_time.tv_nsec - start_time->tv_nsec) / 1000;
+  EscapeJSON(name, sizeof(name), current_trace.name);
+
+  span_bytes = snprintf(span, BUFFER_SIZE,
+                        "{\"trace_id\":\"%s\",\"span_id\":\"%s\","
+                        "\"parent_id\":\"%s\",\"request_id\":\"%s\","
+                        "\"name\":\"%s\",\"code\":%d,"
+                        "\"end_unix_ms\":%lld,\"duration_us\":%lld}\n",
+                        current_trace.trace_id, current_trace.span_id,
+                        current_trace.parent_id, current_trace.request_id,
+                        name, current_trace.code,
+                        wall_time.tv_sec * 1000LL + wall_time.tv_nsec / 1000000,
+                        duration_us);
+  if (span_bytes >= BUFFER_SIZE) {
+    span_bytes = BUFFER_SIZE - 1;
+  }
+  if (write(trace_fd, span, span_bytes) < 0) {
+    perror("[*] SKIP exporting span");
+  }
+}
+
+/**
+ *  @brief  This makes binded server socket and returns that.
+ *  @param portno  The port number
+ *  @return Return server socket (integer), or -1 if failed.
+ */ 
+static int SetupServerSocket(int portno) {
+  int server_socket;
+
+  /** 
+   *  Structure containing an Internet address
+   *  struct sockaddr_in has:
+   *  1) sin_family: Protocol family
+   *  2) sin_port:   16bits port number
+   *  3) sin_addr:   32bits Host IP address
+   *  4) sin_zero:   Dummy data (fill with 0)
+  */
+  struct sockaddr_in serv_addr;
+
+  /**
+   *  Create a server socket
+   *  socket(int domain, int type, int protocol) function:
+   *  1) domain = AF_INET: Protocol family is IPv4
+   *  2) type   = SOCK_STREAM: Protocol type is TCP/IP
+   *  3) socket function returns -1 if failed to open socket
+   */ 
+  server_socket = socket(AF_INET, SOCK_STREAM, 0);
+  if (server_socket < 0) { /* Failed to create socket*/
+    perror("[-] ERROR during opening server socket.");
+    return -1;
+  }
+
+  /* Connections of a stopped server in TIME_WAIT must not block a restart*/
+  {
+    int reuse_address = 1;
+    setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR,
+              &reuse_address, sizeof(reuse_address));
+  }
+
+  memset(&serv_addr, 0, sizeof(serv_addr)); /* Fill serv_addr with 0*/
+
+  /* INADDR_ANY: Bind socket to all available interfaces*/
+  serv_addr.sin_addr.s_addr = INADDR_ANY;
+  serv_addr.sin_family = AF_INET; /* AF_INET: Protocol type is TCP/IP*/
+  serv_addr.sin_port = htons(portno); /* Convert host to network byte order*/
+  
+  /**
+   *  Bind the socket to the server address
+   *  bind function returns -1 if failed to bind address
+   */
+  if (bind(server_socket,
+          (struct sockaddr *) &serv_addr,
+          sizeof(serv_addr)) < 0) { /* Failed to bind socket*/
+    perror("[-] ERROR during binding the server socket.");
+    close(server_socket);
+    return -1;
+  }
+
+  printf("[+] SUCCESS binding the server socket.\n");
+  printf("****************************************\n");
+  return server_socket;
+}
+
+/**
+ *  @brief  This accepts the next client connection.
+ *          SIGTERM is unblocked only inside pselect(), so a SIGTERM that
+ *          arrives after the worker_stopping check still wakes the worker.
+ *          Transient failures (interrupted call, connection aborted by the
+ *          client, memory exhaustion) are retried. When the descriptors
+ *          run out, the spare descriptor is closed to accept the waiting
+ *          connection and close it at once. Otherwise it would keep the
+ *          server socket readable and the worker would spin.
+ *  @param  server_socket  The listening server socket.
+ *  @param  cli_addr  The client socket address to fill.
+ *  @param  client_address_length  Length of client-socket address.
+ *  @return Return client socket (integer), or -1 if the worker is stopping.
+ */
+static int AcceptClient(int server_socket, struct sockaddr_in* cli_addr,
+                socklen_t* client_address_length) {
+  int client_socket,
+      accept_errno; /** errno of the failed accept()*/
+  fd_set accept_set;
+
+  while (1) {
+    /* Wait for a connection, the only place SIGTERM is delivered*/
+    FD_ZERO(&accept_set);
+    FD_SET(server_socket, &accept_set);
+    if (pselect(server_socket + 1, &accept_set, NULL, NULL, NULL,
+                &accept_mask) < 0) {
+      if (errno == EINTR && worker_stopping) { /* Stopped by SIGTERM*/
+        return -1;
+      } else if (errno != EINTR) {
+        error("[-] ERROR during waiting for client socket.");
+      }
+      continue;
+    }
+
+    *client_address_length = sizeof(*cli_addr);
+    client_socket = accept(server_socket,
+                          (struct sockaddr *) cli_addr,
+                          client_address_length);
+    if (client_socket >= 0) {
+#ifndef __linux__
+      /* BSD sockets inherit O_NONBLOCK from the server socket*/
+      fcntl(client_socket, F_SETFL,
+            fcntl(client_socket, F_GETFL) & ~O_NONBLOCK);
+#endif
+      return client_socket;
+    }
+
+    accept_errno = errno;
+    if (accept_errno == EAGAIN || accept_errno == EWOULDBLOCK) {
+      continue; /* Another worker took the connection*/
+    }
+    if (accept_errno != EINTR && accept_errno != ECONNABORTED &&
+        accept_errno != EPROTO && accept_errno != EMFILE &&
+        accept_errno != ENFILE && accept_errno != ENOBUFS &&
+        accept_errno != ENOMEM) { /* Not a transient error*/
+      error("[-] ERROR during accept client socket.");
+    }
+
+    perror("[*] RETRY accept client socket");
+    if ((accept_errno == EMFILE || accept_errno == ENFILE) && spare_fd >= 0) {
+      /* Shed the waiting connection with the spare descriptor*/
+      close(spare_fd);
+      client_socket = accept(server_socket, NULL, NULL);
+      if (client_socket >= 0) {
+        printf("[-] ERROR out of descriptors, a connection is closed.\n");
+        close(client_socket);
+      }
+      spare_fd = open("/dev/null", O_RDONLY);
+    } else if (accept_errno != EINTR && accept_errno != ECONNABORTED &&
+              accept_errno != EPROTO) {
+      usleep(10000);  /* Wait for descriptors or memory to be released*/
+    }
+  }
+}
+
+/**
+ *  @brief  This is HTTP listener function.
+ *  @param  client_socket Request from the client socket.
+ *  @param  buffer  The buffer to read from the http message.
+ *  @return Return the number of bytes read, or -1 if failed.
+ */
+static int ListenRequest(int client_socket, char *buffer) {
+  int request_bytes;
+  memset(buffer,0x00,BUFFER_SIZE); /* Clear buffer*/
+  
+  /* Read request from the client socket.*/
+  do {
+    request_bytes = read(client_socket, buffer, BUFFER_SIZE -1);
+  } while (request_bytes < 0 && errno == EINTR);
+  if (request_bytes < 0) { /* Failed to read, the client is gone*/
+    perror("[-] ERROR during reading request from client");
+  }
+
+  return request_bytes;
+}
+
+/**
+ *  @brief  This function parses buffer to http-request-header and
+ *          http-request-body.
+ *  @param  req_header_line  The filled request header pointer.
+ *  @param  request_body  The filled request body pointer.
+ *  @param  buffer  Total request message from client.
+ *  @return Returns number of request body lines.
+ */
+static int ParseHTTPRequest(httpd_request_line* req_header_line,
+                    httpd_message request_body[],
+                    char *buffer) {
+  int request_body_line = 0;  /* The number of request lines*/
+  char  *token,
+        *rest_buffer;
+
+  printf("%s", buffer); /* Dump the HTTP Request (Part A)*/
+
+  /* Seperate header and body*/
+  token = strtok_r(buffer,"\n", &rest_buffer);
+  if (token == NULL) { /* No request line*/
+    req_header_line->action = "";
+    req_header_line->location = "";
+    req_header_line->http_version = "";
+    return 0;
+  }
+  if (token[strlen(token) - 1] == '\r') {
+    token[strlen(token) - 1] = '\0';
+  }
+
+  /* Parse and save the request header line*/
+  req_header_line->action = strtok(token," ");
+  req_header_line->location = strtok(NULL," ");
+  req_header_line->http_version = strtok(NULL," ");
+  if (req_header_line->action == NULL) {  /* Request line is cut short*/
+    req_header_line->action = "";
+  }
+  if (req_header_line->location == NULL) {
+    req_header_line->location = "";
+  }
+  if (req_header_line->http_version == NULL) {
+    req_header_line->http_version = "";
+  }
+
+  /* Parse and save the request header line*/
+  for(request_body_line = 0; token != NULL; request_body_line++) {
+    token = strtok_r(rest_buffer, "\n", &rest_buffer);
+    request_body[request_body_line].field = strtok(token,":");
+    request_body[request_body_line].data = strtok(NULL,"\n");
+  }
+
+  return request_body_line - 1;
+}
+
+/**
+ *  @brief  This finds the value of a request header field.
+ *          Leading spaces and the trailing '\r' of the value are removed.
+ *  @param  request_body  The parsed request body.
+ *  @param  request_body_line  The number of request body lines.
+ *  @param  field  The field name to find. (case-insensitive)
+ *  @return Return the field value, or NULL if the field does not exist.
+ */
+char* HttpdGetHeader(httpd_message request_body[], int request_body_line,
+                    char* field) {
+  int i;
+  char* value;
+  size_t value_length;
+
+  for (i = 0; i < request_body_line; i++) {
+    if (request_body[i].field == NULL ||
+        request_body[i].field[0] == '\r') { /* End of header fields*/
+      break;
+    }
+    if (strcasecmp(request_body[i].field, field) != 0 ||
+        request_body[i].data == NULL) {
+      continue;
+    }
+
+    value = request_body[i].data;
+    while (*value == ' ') {
+      value++;
+    }
+    value_length = strlen(value);
+    if (0 < value_length && value[value_length - 1] == '\r') {
+      value[value_length - 1] = '\0';
+    }
+    return value;
+  }
+
+  return NULL;
+}
+
+/**
+ *  @brief  This function parses buffer to http-request-header and
+ *          http-request-body.
+ *          A request matching a registered route is passed to its handler,
+ *          otherwise the static file is sent.
+ *  @param  server  The server.
+ *  @param  Request from the client socket.
+ *  @param  req_header_line  The request header pointer.
+ *  @param  request_body  The request body pointer. Use this data
+ *                        if request message is needed.
+ *  @param  request_body_line  The number of request body lines.
+ *  @param  content  The message body read with the header.
+ *  @param  buffer  Total request message from client.
+ *  @return Returns number of request body lines.
+ */
+static int BuildResponse(httpd_server* server, int client_socket,
+                        httpd_request_line* req_header_line,
+                        httpd_message request_body[], int request_body_line,
+                        httpd_content* content, char *buffer) {
+  off_t request_body_bytes = 0;  /** Response message's bytes*/
+  int code, /** Response status code*/
+      file_fd;  /** Descriptor of the response file*/
+  char  *file_name, *file_extension;  /* {file_name}.{file_extension}*/
+  char  filesrc[BUFFER_SIZE]; /* Full name of file. {file_name.file_extension}*/
+  char  etag[MAX_LINE], /* Entity tag of the request file*/
+        *if_none_match, /* Entity tag cached by the client*/
+        *content_encoding = NULL; /* Encoding of a precompressed variant*/
+  struct stat file_stat;
+  struct timespec start_time; /** Time the response started*/
+  File_t filetype;  /** Request file type*/
+
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+  if (req_header_line->location[0] != '/' ||
+      strncmp(req_header_line->http_version, "HTTP/", 5) != 0) {
+    /* Malformed request line, 400 Bad Request*/
+    printf("[*] RESPONSE request line is invalid\n");
+    return HttpdRespond(client_socket, "HTTP/1.1", 400);
+  }
+
+  /* Registered routes first*/
+  for (code = 0; code < server->route_count; code++) {
+    if (strcmp(server->routes[code].action, req_header_line->action) == 0 &&
+        strcmp(server->routes[code].location, req_header_line->location) == 0) {
+      return server->routes[code].handler(client_socket, req_header_line,
+                                          request_body, request_body_line,
+                                          content, server->routes[code].arg);
+    }
+  }
+
+  memset(filesrc, 0x00, BUFFER_SIZE);
+  strcpy(filesrc, req_header_line->location + 1); /* Save original file source*/
+
+  if (strcmp(req_header_line->location, "/") == 0) { /* Input is {IP}:{port}*/
+    filetype = NO_FILE;
+  } else if (strchr(filesrc, '.') == NULL || 
+            filesrc[strlen(filesrc)-1] == '.' ||
+            filesrc[0] == '.') {
+    /* Input has no-type. "/{example}" or "/{example.}"*/
+    file_name = filesrc;
+    file_extension = NULL;
+    filetype = UNKNOWN_FILE;
+  } else {
+    /* Divide file source into {file_name}.{file_extension}*/
+    file_name = strtok_r(req_header_line->location, ".", &file_extension);
+    
+    /* Check request file type*/
+    if (strcmp(file_extension, "html") == 0) {
+      filetype = HTML_FILE;
+    } else if (strcmp(file_extension, "gif") == 0) {
+      filetype = GIF_FILE;
+    } else if (strcmp(file_extension, "jpeg") == 0) {
+      filetype = JPEG_FILE;
+    } else if (strcmp(file_extension, "mp3") == 0) {
+      filetype = MP3_FILE;
+    } else if (strcmp(file_extension, "pdf") == 0) {
+      filetype = PDF_FILE;
+    } else {
+      filetype = UNKNOWN_FILE;
+    }
+  }
+
+  if (strcmp(req_header_line->action, "GET") == 0) {
+    /* GET method inputed*/
+    /* Set status code by request file*/
+    if (filetype == NO_FILE) {
+      /* Route to 'index.html', 301 Moved Permanetly*/
+      printf("[*] RESPONSE \"/\" here.\n");
+      code = 200;
+      strcpy(filesrc, "html/index.html");
+      filetype = HTML_FILE;
+      file_fd = OpenRequestFile(server->docroot_fd, filesrc, &file_stat);
+      // error("[-] ERROR GET / failed");
+    } else if ((file_fd = OpenRequestFile(server->docroot_fd, filesrc, &file_stat)) >= 0) {
+      /* Exist the request file, 200 OK*/
+      printf("[*] RESPONSE \"%s\" exists\n", filesrc);
+      code = 200;
+    } else {
+      /* 404 Not Found*/
+      printf("[*] RESPONSE \"%s\" does not exists\n", filesrc);
+      code = 404;
+      filetype = HTML_FILE;
+      strcpy(filesrc, "html/404.html");
+      file_fd = OpenRequestFile(server->docroot_fd, filesrc, &file_stat);
+    }
+    if (file_fd < 0) { /* index.html or 404.html is missing*/
+      printf("[-] ERROR during opening \"%s\"\n", filesrc);
+      return HttpdRespond(client_socket, req_header_line->http_version, 404);
+    }
+
+    /* Send a precompressed variant of a text file if the client accepts it*/
+    if (filetype == HTML_FILE) {
+      content_encoding = OpenEncodedFile(server->docroot_fd, filesrc,
+                                        HttpdGetHeader(request_body, request_body_line,
+                                                      "Accept-Encoding"),
+                                        &file_fd, &file_stat);
+    }
+
+    /* The client's cached copy is still current, 304 Not Modified*/
+    if_none_match = HttpdGetHeader(request_body, request_body_line,
+                                  "If-None-Match");
+    if (code == 200 && if_none_match != NULL) {
+      MakeETag(&file_stat, etag);
+      if (strcmp(if_none_match, etag) == 0 ||
+          strcmp(if_none_match, "*") == 0) {
+        printf("[*] RESPONSE \"%s\" not modified\n", filesrc);
+        code = 304;
+      }
+    }
+
+    /* Send response message*/
+    SetSendPriority(client_socket, (code == 304) ? 0 : file_stat.st_size);
+    CorkSocket(client_socket, 1);
+    if (ResponseHeader(client_socket, req_header_line->http_version, code,
+                      filetype, filesrc, &file_stat, content_encoding,
+                      NULL, 0, file_stat.st_size) != SUCCESS_RESULT) {
+      close(file_fd); /* Client is gone, skip the body*/
+      return FAILURE_RESULT;
+    }
+    if (code == 304) { /* 304 response has no body*/
+      CorkSocket(client_socket, 0);
+    } else if (StartBulkTransfer(server, file_stat.st_size) <= 0) {
+      /* Small body, or the bulk transfer process itself*/
+      request_body_bytes = ResponseBody(client_socket, buffer, filesrc, filetype,
+                                        file_fd, &file_stat);
+      CorkSocket(client_socket, 0); /* Flush the last partial segment*/
+      LogTCPInfo(client_socket, &start_time);
+      if (bulk_transfers < 0) { /* Bulk transfer process is done*/
+        fflush(stdout);
+        _exit(0);
+      }
+    }
+    close(file_fd);
+    printf("[*] RESPONSE body:: %lld bytes\n", (long long) request_body_bytes);
+  } else if (strcmp(req_header_line->action, "POST") == 0) {
+    /* POST method inputed. No route accepts it, 404 Not Found*/
+    HttpdRespond(client_socket, req_header_line->http_version, 404);
+    DrainRequest(client_socket);
+  } else {  /* Other methods are not supported, 501 Not Implemented*/
+    printf("[*] RESPONSE \"%s\" is not implemented\n", req_header_line->action);
+    return HttpdRespond(client_socket, req_header_line->http_version, 501);
+  }
+
+  return SUCCESS_RESULT;
+}
+
+/**
+ *  @brief  This is the multipart/form-data upload handler.
+ *          Files are saved to UPLOAD_DIR under the document root, and are
+ *          never served back. It is not routed by default, register it
+ *          with HttpdRoute() (eg. POST /upload) to accept uploads, with
+ *          the server as arg.
+ *  @param  client_socket  Request from the client socket.
+ *  @param  req_header_line  The request header pointer.
+ *  @param  request_body  The parsed request body.
+ *  @param  request_body_line  The number of request body lines.
+ *  @param  content  The message body read with the header.
+ *  @param  arg  The server the files are uploaded to.
+ *  @return Return 0 if successful.
+ */
+int HttpdUploadHandler(int client_socket, httpd_request_line* req_header_line,
+                      httpd_message request_body[], int request_body_line,
+                      httpd_content* content, void* arg) {
+  httpd_server* server = arg;
+  int code = ReceiveUpload(client_socket, server->docroot_fd,
+                          req_header_line->http_version,
+                          request_body, request_body_line, content),
+      result = HttpdRespond(client_socket, req_header_line->http_version,
+                            code);
+
+  if (code != 201) {  /* The body may be left unread*/
+    DrainRequest(client_socket);
+  }
+  return result;
+}
+
+/**
+ *  @brief  This receives the files uploaded by POST multipart/form-data.
+ *          The Expect, Content-Length and Content-Type are
+ *          checked from the header alone. A client that sent
+ *          "Expect: 100-continue" gets "100 Continue" only when they pass,
+ *          so a rejected upload never transfers its body. HTTP/1.0 has no
+ *          "100 Continue", so such a client sends the body unasked.
+ *  @param  client_socket  Request from the client socket.
+ *  @param  docroot_fd  The document root the file is under.
+ *  @param  http_version  Request HTTP version.
+ *  @param  request_body  The parsed request body.
+ *  @param  request_body_line  The number of request body lines.
+ *  @param  content  The message body read with the header.
+ *  @return Return the response status code.
+ */
+static int ReceiveUpload(int client_socket, int docroot_fd, char* http_version,
+                        httpd_message request_body[], int request_body_line,
+                        httpd_content* content) {
+  char  *content_type,
+        *content_length,
+        *expect,
+        continue_line[MAX_LINE],
+        *boundary_start,
+        boundary[MAX_BOUNDARY + 1];
+  size_t boundary_length;
+  off_t body_size;
+  int code;
+
+  expect = HttpdGetHeader(request_body, request_body_line, "Expect");
+  if (expect != NULL && strcasecmp(expect, "100-continue") != 0) {
+    return 417; /* Unknown expectation*/
+  }
+
+  content_length = HttpdGetHeader(request_body, request_body_line,
+                                  "Content-Length");
+  if (content_length == NULL) { /* Chunked body is not supported*/
+    return 411;
+  }
+  body_size = strtoll(content_length, NULL, 10);
+  if (body_size < 0 || MAX_UPLOAD_SIZE < body_size) {
+    printf("[*] UPLOAD rejected, %lld bytes\n", (long long) body_size);
+    return 413;
+  }
+
+  /* Content-Type: multipart/form-data; boundary={boundary}*/
+  content_type = HttpdGetHeader(request_body, request_body_line,
+                                "Content-Type");
+  if (content_type == NULL ||
+      strncasecmp(content_type, "multipart/form-data", 19) != 0 ||
+      (boundary_start = strstr(content_type, "boundary=")) == NULL) {
+    return 415;
+  }
+  boundary_start += 9;
+  if (*boundary_start == '"') { /* Quoted boundary*/
+    boundary_start++;
+  }
+  boundary_length = strcspn(boundary_start, "\";");
+  if (boundary_length == 0 || MAX_BOUNDARY < boundary_length) {
+    return 400;
+  }
+  memcpy(boundary, boundary_start, boundary_length);
+  boundary[boundary_length] = '\0';
+
+  /* The header is acceptable. Let the client send the body*/
+  if (expect != NULL && content->length == 0 &&
+      strcmp(http_version, "HTTP/1.0") != 0) { /* Not sent to HTTP/1.0*/
+    snprintf(continue_line, MAX_LINE, "%s 100 Continue\r\n\r\n", http_version);
+    if (WriteAll(client_socket, continue_line, strlen(continue_line)) < 0) {
+      return 400;
+    }
+  }
+
+  code = ReceiveMultipart(client_socket, docroot_fd, content, body_size,
+                          boundary);
+  if (code != 201) {
+    printf("[-] ERROR receiving multipart body (%d).\n", code);
+    return code;
+  }
+
+  printf("[+] SUCCESS receiving multipart body (%lld bytes).\n",
+        (long long) body_size);
+  return 201;
+}
+
+/**
+ *  @brief  This is the streaming multipart/form-data parser.
+ *          The body is parsed through a MULTIPART_WINDOW buffer. The content
+ *          of each part is written to its file as soon as it is known not
+ *          to hold a boundary, so memory stays constant for any body size.
+ *          Only the last (delimiter length - 1) bytes are kept back, since
+ *          a delimiter may be split between two reads.
+ *  @param  client_socket  Request from the client socket.
+ *  @param  docroot_fd  The document root the file is under.
+ *  @param  content  The message body read with the header.
+ *  @param  content_length  Bytes of the whole message body.
+ *  @param  boundary  The multipart boundary.
+ *          The files are kept only if the whole body is valid. When the
+ *          request fails, every file it created is removed.
+ *  @return Return 201 if every file was saved, 400 if the body or a file
+ *          name is invalid, 409 if a file exists, 413 if there are more
+ *          than MAX_UPLOAD_FILES files, 500 if a file cannot be written.
+ */
+static int ReceiveMultipart(int client_socket, int docroot_fd,
+                            httpd_content* content, off_t content_length,
+                            char* boundary) {
+  char  window[MULTIPART_WINDOW],
+        delimiter[MAX_BOUNDARY + 5],  /** "\r\n--{boundary}"*/
+        saved_paths[MAX_UPLOAD_FILES + 1][UPLOAD_PATH_SIZE],  /** Created files*/
+        *found;
+  size_t delimiter_length,
+        window_length,
+        start,  /** First byte of the window not parsed yet*/
+        keep_length;
+  ssize_t read_bytes;
+  off_t remain_length = content_length; /** Body bytes not read yet*/
+  int state = MULTIPART_PREAMBLE,
+      code = 400, /** Response status if the body does not complete*/
+      saved_count = 0,  /** Number of files created*/
+      part_fd = -1, /** File of the current part, -1 for a form field*/
+      i;
+
+  delimiter_length = sprintf(delimiter, "\r\n--%s", boundary);
+  keep_length = delimiter_length - 1;
+
+  /* The first boundary has no CRLF before it. Start the window with one*/
+  memcpy(window, "\r\n", 2);
+  window_length = 2;
+
+  while (state != MULTIPART_DONE) {
+    /* Fill the window*/
+    read_bytes = MULTIPART_WINDOW - window_length;
+    if (remain_length < read_bytes) {
+      read_bytes = remain_length;
+    }
+    read_bytes = HttpdReadContent(client_socket, content,
+                            window + window_length, read_bytes);
+    if (read_bytes < 0) { /* Connection closed before the body ended*/
+      break;
+    }
+    remain_length -= read_bytes;
+    window_length += read_bytes;
+
+    /* Parse the window as far as possible*/
+    start = 0;
+    while (state != MULTIPART_DONE) {
+      if (state == MULTIPART_HEADERS) {
+        found = FindDelimiter(window + start, window_length - start,
+                              "\r\n\r\n", 4);
+        if (found == NULL) {  /* Need more bytes*/
+          break;
+        }
+        *found = '\0';
+        code = OpenPartFile(docroot_fd, window + start,
+                            saved_paths[saved_count], &part_fd);
+        if (code != SUCCESS_RESULT) { /* File part that cannot be saved*/
+          state = -1;
+          break;
+        }
+        code = 400;
+        if (part_fd >= 0 && ++saved_count > MAX_UPLOAD_FILES) {
+          code = 413;
+          state = -1;
+          break;
+        }
+        start = found + 4 - window;
+        state = MULTIPART_DATA;
+        continue;
+      }
+
+      found = FindDelimiter(window + start, window_length - start,
+                            delimiter, delimiter_length);
+      if (found == NULL ||
+          (size_t) (found - window) + delimiter_length + 2 > window_length) {
+        /* Keep the bytes that may be the start of a delimiter*/
+        size_t end = (found != NULL) ? (size_t) (found - window) :
+                    (window_length - start > keep_length) ?
+                    window_length - keep_length : start;
+        if (state == MULTIPART_DATA && part_fd >= 0 &&
+            WriteAll(part_fd, window + start, end - start) < 0) {
+          perror("[-] ERROR during saving uploaded file");
+          code = 500;
+          state = -1;
+          break;
+        }
+        start = end;
+        break;
+      }
+
+      /* End of the part (or of the preamble)*/
+      if (state == MULTIPART_DATA) {
+        if (part_fd >= 0 &&
+            WriteAll(part_fd, window + start, found - (window + start)) < 0) {
+          perror("[-] ERROR during saving uploaded file");
+          code = 500;
+          state = -1;
+          break;
+        }
+      }
+
+      found += delimiter_length;
+      if (found[0] == '-' && found[1] == '-') { /* Close delimiter*/
+        state = MULTIPART_DONE;
+      } else if (found[0] == '\r' && found[1] == '\n') {
+        state = MULTIPART_HEADERS;
+      } else {  /* Boundary text inside a line*/
+        state = -1;
+        break;
+      }
+      start = found + 2 - window;
+      if (part_fd >= 0) { /* The part is complete*/
+        close(part_fd);
+        part_fd = -1;
+        printf("[*] UPLOAD saved %s\n", saved_paths[saved_count - 1]);
+      }
+    }
+    if (state < 0) {
+      break;
+    }
+
+    /* Move the bytes not parsed yet to the front*/
+    memmove(window, window + start, window_length - start);
+    window_length -= start;
+    if (state != MULTIPART_DONE &&
+        (remain_length == 0 || window_length == MULTIPART_WINDOW)) {
+      break;  /* Body ended early, or part header is too long*/
+    }
+  }
+
+  if (part_fd >= 0) {
+    close(part_fd);
+  }
+  if (state != MULTIPART_DONE) {  /* Remove every file of the request*/
+    for (i = 0; i < saved_count; i++) {
+      unlinkat(docroot_fd, saved_paths[i], 0);
+      printf("[*] UPLOAD removed %s\n", saved_paths[i]);
+    }
+    return code;
+  }
+
+  /* Discard the epilogue after the close delimiter*/
+  while (remain_length > 0) {
+    read_bytes = HttpdReadContent(client_socket, content, window,
+                            (remain_length < MULTIPART_WINDOW) ?
+                            remain_length : MULTIPART_WINDOW);
+    if (read_bytes < 0) {
+      break;
+    }
+    remain_length -= read_bytes;
+  }
+
+  return 201;
+}
+
+/**
+ *  @brief  This reads the next bytes of the message body.
+ *          The bytes read with the header are returned first, then the
+ *          client socket is read.
+ *  @param  client_socket  Request from the client socket.
+ *  @param  content  The message body read with the header.
+ *  @param  buffer  The buffer to read into.
+ *  @param  length  Bytes to read. (at most)
+ *  @return Return read bytes, or -1 if the connection is closed or failed.
+ */
+ssize_t HttpdReadContent(int client_socket, httpd_content* content,
+                        char* buffer, size_t length) {
+  ssize_t read_bytes;
+
+  if (length == 0) {
+    return 0;
+  }
+
+  if (content->length > 0) {  /* Body bytes read with the header*/
+    if (length > content->length) {
+      length = content->length;
+    }
+    memcpy(buffer, content->data, length);
+    content->data += length;
+    content->length -= length;
+    return length;
+  }
+
+  do {
+    read_bytes = read(client_socket, buffer, length);
+  } while (read_bytes < 0 && errno == EINTR);
+  if (read_bytes <= 0) {  /* Closed or failed*/
+    return -1;
+  }
+  return read_bytes;
+}
+
+/**
+ *  @brief  This finds a delimiter in data.
+ *          memchr() scans for the first byte of the delimiter (libc
+ *          vectorizes it), and memcmp() checks the rest only at those
+ *          candidates.
+ *  @param  data  The data to search.
+ *  @param  length  Bytes of the data.
+ *  @param  delimiter  The delimiter to find.
+ *  @param  delimiter_length  Bytes of the delimiter.
+ *  @return Return the first position of the delimiter, or NULL.
+ */
+static char* FindDelimiter(char* data, size_t length, char* delimiter,
+                    size_t delimiter_length) {
+  char  *candidate,
+        *end = data + length;
+
+  while ((size_t) (end - data) >= delimiter_length) {
+    candidate = memchr(data, delimiter[0],
+                      (end - data) - delimiter_length + 1);
+    if (candidate == NULL) {
+      return NULL;
+    }
+    if (memcmp(candidate + 1, delimiter + 1, delimiter_length - 1) == 0) {
+      return candidate;
+    }
+    data = candidate + 1;
+  }
+
+  return NULL;
+}
+
+/**
+ *  @brief  This opens the file to save the content of a part.
+ *          The file name is taken from the filename parameter of
+ *          Content-Disposition, without any directory in it.
+ *          An existing file is never replaced.
+ *  @param  docroot_fd  The document root the file is under.
+ *  @param  part_headers  The header lines of the part.
+ *  @param  part_path  The buffer to write the path of the file.
+ *                    (UPLOAD_PATH_SIZE bytes)
+ *  @param  part_fd  The file descriptor to set, -1 if the part is a form field.
+ *  @return Return 0 if successful, 400 if the file name is invalid,
+ *          409 if the file exists, 500 if the file cannot be created.
+ */
+static int OpenPartFile(int docroot_fd, char* part_headers, char* part_path,
+                        int* part_fd) {
+  char  *file_name,
+        *slash;
+  size_t name_length;
+
+  /* Content-Disposition: form-data; name="{name}"; filename="{file_name}"*/
+  *part_fd = -1;
+  file_name = strstr(part_headers, "filename=\"");
+  if (file_name == NULL) {  /* Form field*/
+    return SUCCESS_RESULT;
+  }
+  file_name += 10;
+  name_length = strcspn(file_name, "\"\r\n");
+
+  /* Browsers may send a full client path. Keep the last component*/
+  while ((slash = memchr(file_name, '/', name_length)) != NULL ||
+        (slash = memchr(file_name, '\\', name_length)) != NULL) {
+    name_length -= slash + 1 - file_name;
+    file_name = slash + 1;
+  }
+  if (name_length == 0 || file_name[0] == '.' ||
+      name_length > MAX_LINE) {
+    printf("[-] ERROR uploaded file name is invalid.\n");
+    return 400;
+  }
+
+  mkdirat(docroot_fd, UPLOAD_DIR, 0755);
+  snprintf(part_path, UPLOAD_PATH_SIZE, "%s/%.*s", UPLOAD_DIR,
+          (int) name_length, file_name);
+  *part_fd = openat(docroot_fd, part_path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+  if (*part_fd < 0) {
+    int open_errno = errno; /* perror() may change errno*/
+
+    perror("[-] ERROR during creating uploaded file");
+    return (open_errno == EEXIST) ? 409 : 500;
+  }
+  return SUCCESS_RESULT;
+}
+
+/**
+ *  @brief  This opens the request file and gets its stat by one lookup.
+ *          The descriptor and stat are reused for the response header
+ *          and body, so the path is resolved only once per request.
+ *          Uploaded files are never served, they are not trusted content.
+ *  @param  docroot_fd  The document root the file is under.
+ *  @param  filesrc  The request file name.
+ *  @param  file_stat  The stat of the file to fill.
+ *  @return Return file descriptor, or -1 if it is not a servable file.
+ */
+static int OpenRequestFile(int docroot_fd, char* filesrc,
+                          struct stat* file_stat) {
+  int file_fd;
+
+  if (filesrc[0] == '/' ||
+      strstr(filesrc, "..") != NULL) { /* Do not leave the document root*/
+    return -1;
+  }
+  while (filesrc[0] == '.' && filesrc[1] == '/') {  /* "./upload/..."*/
+    filesrc += 2;
+    while (filesrc[0] == '/') {
+      filesrc++;
+    }
+  }
+  if (strncasecmp(filesrc, UPLOAD_DIR, sizeof(UPLOAD_DIR) - 1) == 0 &&
+      (filesrc[sizeof(UPLOAD_DIR) - 1] == '/' ||
+      filesrc[sizeof(UPLOAD_DIR) - 1] == '\0')) {  /* Uploaded files*/
+    return -1;
+  }
+
+  file_fd = openat(docroot_fd, filesrc, O_RDONLY);
+  if (file_fd < 0) { /* The file does not exist*/
+    return -1;
+  }
+  if (fstat(file_fd, file_stat) < 0 ||
+      !S_ISREG(file_stat->st_mode)) { /* Directory or special file*/
+    close(file_fd);
+    return -1;
+  }
+
+  return file_fd;
+}
+
+/**
+ *  @brief  This checks that an Accept-Encoding value lists an encoding.
+ *          An encoding listed with q=0 is refused.
+ *  @param  accept_encoding  The Accept-Encoding value, or NULL.
+ *  @param  encoding  The content encoding to find. (eg. gzip)
+ *  @return Return 1 if the client accepts the encoding, otherwise 0.
+ */
+static int AcceptsEncoding(char* accept_encoding, char* encoding) {
+  char  *token = accept_encoding;
+  size_t encoding_length = strlen(encoding);
+
+  while (token != NULL && *token != '\0') {
+    token += strspn(token, " ,");
+    if (strncasecmp(token, encoding, encoding_length) == 0 &&
+        strchr(" ,;", token[encoding_length]) != NULL) {
+      /* "gzip;q=0" means gzip is not acceptable*/
+      token += encoding_length;
+      token += strspn(token, " ");
+      if (strncmp(token, ";q=", 3) == 0) {
+        return strtod(token + 3, NULL) > 0;
+      }
+      return 1;
+    }
+    token = strchr(token, ',');
+  }
+
+  return 0;
+}
+
+/**
+ *  @brief  This opens a precompressed variant of the request file.
+ *          {filesrc}.zst, {filesrc}.br and {filesrc}.gz are tried in
+ *          order. A variant older than the file itself is stale and
+ *          skipped.
+ *  @param  docroot_fd  The document root the file is under.
+ *  @param  filesrc  The request file name.
+ *  @param  accept_encoding  The Accept-Encoding value, or NULL.
+ *  @param  file_fd  The descriptor of the request file. Replaced by the
+ *                  variant's descriptor when one is opened.
+ *  @param  file_stat  The stat of the request file. Replaced the same way.
+ *  @return Return the Content-Encoding of the variant, or NULL.
+ */
+static char* OpenEncodedFile(int docroot_fd, char* filesrc,
+                            char* accept_encoding, int* file_fd,
+                            struct stat* file_stat) {
+  char  encoded_src[BUFFER_SIZE];
+  struct stat encoded_stat;
+  int encoded_fd,
+      i;
+
+  for (i = 0; i < ENCODING_COUNT; i++) {
+    if (!AcceptsEncoding(accept_encoding, Content_Encodings[i])) {
+      continue;
+    }
+    snprintf(encoded_src, BUFFER_SIZE, "%s%s", filesrc, Encoding_Suffixes[i]);
+    encoded_fd = OpenRequestFile(docroot_fd, encoded_src, &encoded_stat);
+    if (encoded_fd < 0) {
+      continue;
+    } else if (encoded_stat.st_mtime < file_stat->st_mtime) { /* Stale*/
+      close(encoded_fd);
+      continue;
+    }
+
+    printf("[*] RESPONSE \"%s\" as %s\n", filesrc, Content_Encodings[i]);
+    close(*file_fd);
+    *file_fd = encoded_fd;
+    *file_stat = encoded_stat;
+    return Content_Encodings[i];
+  }
+
+  return NULL;
+}
+
+/**
+ *  @brief  This makes the entity tag of a file from its mtime and size.
+ *          The tag changes whenever the file is replaced or rewritten.
+ *  @param  file_stat  The stat of the file.
+ *  @param  etag  The buffer to write the entity tag.
+ *  @return Return nothing
+ */
+static void MakeETag(struct stat* file_stat, char* etag) {
+  sprintf(etag, "\"%llx-%llx\"",
+          (unsigned long long) file_stat->st_mtime,
+          (unsigned long long) file_stat->st_size);
+}
+
+/**
+ *  @brief  This responses the http header function.
+ *  @param  client_socket Request from the client socket.
+ *  @param  http_version  Request HTTP version.
+ *  @param  code  statue code number.
+ *  @param  filetype  Index of MINE types.
+ *  @param  filesrc  The request file name.
+ *  @param  file_stat  The stat of the request file, or NULL if no body.
+ *  @param  content_encoding  The encoding of the body, or NULL.
+ *  @param  headers  More header fields from a route handler, or NULL.
+ *  @param  header_count  The number of headers.
+ *  @param  body_length  Bytes of the body sent after the header.
+ *  @return Return 0 if successful.
+ */ 
+static int ResponseHeader(int client_socket, char* http_version, int code,
+                          File_t filetype, char* filesrc, struct stat* file_stat,
+                          char* content_encoding, httpd_message headers[],
+                          int header_count, off_t body_length) {
+  char  response_header[BUFFER_SIZE]; /** Buffer to save response header.*/
+  char  *status,
+        *type_comment,
+        *file_name;
+  int header_bytes, /** Writen file's bytes*/
+      message_size = 0, /** Number of HTTP header messages*/
+      i;
+  httpd_message messages[MAX_LINE];  /** Buffer's array to save response headers.*/
+  char  last_modified[MAX_LINE],  /** Last-Modified header value*/
+        content_length[MAX_LINE], /** Content-Length header value*/
+        content_message[BUFFER_SIZE], /** Content-Disposition header value*/
+        etag[MAX_LINE]; /** ETag header value*/
+
+  /* Set status message by status code.*/
+  if (code == 200) {
+    status = "OK";
+  } else if (code == 201) {
+    status = "Created";
+  } else if (code == 301) {
+    status = "Moved Permanently";
+  } else if (code == 304) {
+    status = "Not Modified";
+  } else if (code == 400) {
+    status = "Bad Request";
+  } else if (code == 403) {
+    status = "Forbidden";
+  } else if (code == 404) {
+    status = "Not Found";
+  } else if (code == 405) {
+    status = "Method Not Allowed";
+  } else if (code == 409) {
+    status = "Conflict";
+  } else if (code == 411) {
+    status = "Length Required";
+  } else if (code == 413) {
+    status = "Payload Too Large";
+  } else if (code == 415) {
+    status = "Unsupported Media Type";
+  } else if (code == 417) {
+    status = "Expectation Failed";
+  } else if (code == 500) {
+    status = "Internal Server Error";
+  } else if (code == 501) {
+    status = "Not Implemented";
+  } else {  /* Code from a route handler. The reason phrase is optional*/
+    status = "";
+  }
+
+  if (0 < filetype && filetype < 6) { /* Known file type*/
+    messages[message_size].field = "Content-Type";
+    messages[message_size++].data = Content_Types[filetype];
+    
+    messages[message_size].field = "Accept-Ranges";
+    messages[message_size++].data = "bytes";
+    if(filetype == PDF_FILE ||
+      filetype == MP3_FILE) { /* Display PDF/MP3 file on browser*/
+      file_name = strrchr(filesrc, '/');  /* Name without the directories*/
+      snprintf(content_message, BUFFER_SIZE, "inline; filename=\"%s\"",
+              (file_name != NULL) ? file_name + 1 : filesrc);
+      messages[message_size].field = "Content-Disposition";
+      messages[message_size++].data = content_message;
+    }
+  } else {  /* Unknown file type*/
+    type_comment = "text/plain";  /* Display file as text*/
+  }
+
+  if (filetype == HTML_FILE) { /* Body may be a precompressed variant*/
+    if (content_encoding != NULL) {
+      messages[message_size].field = "Content-Encoding";
+      messages[message_size++].data = content_encoding;
+    }
+    messages[message_size].field = "Vary";
+    messages[message_size++].data = "Accept-Encoding";
+  }
+
+  if (code != 304) { /* Body length*/
+    sprintf(content_length, "%lld", (long long) body_length);
+    messages[message_size].field = "Content-Length";
+    messages[message_size++].data = content_length;
+  }
+
+  if (file_stat != NULL && (code == 200 || code == 304)) {
+    /* Validators for a client revalidating its cached copy*/
+    strftime(last_modified, MAX_LINE, "%a, %d %b %Y %H:%M:%S GMT",
+            gmtime(&file_stat->st_mtime));
+    messages[message_size].field = "Last-Modified";
+    messages[message_size++].data = last_modified;
+
+    MakeETag(file_stat, etag);
+    messages[message_size].field = "ETag";
+    messages[message_size++].data = etag;
+  } else if (HttpdGetHeader(headers, header_count,
+                            "Cache-Control") == NULL) {
+    /* Error pages must not be cached*/
+    messages[message_size].field = "Cache-Control";
+    messages[message_size++].data = "no-store";
+  }
+
+  for (i = 0; i < header_count && message_size < MAX_LINE - 1; i++) {
+    messages[message_size++] = headers[i];  /* Header fields of the handler*/
+  }
+
+  if (current_trace.request_id[0] != '\0') { /* Let the client follow the request*/
+    messages[message_size].field = "X-Request-Id";
+    messages[message_size++].data = current_trace.request_id;
+    messages[message_size].field = "traceparent";
+    messages[message_size++].data = current_trace.traceparent;
+    current_trace.code = code;
+  }
+
+  messages[message_size].field = "Connection";
+  messages[message_size++].data = "close";
+
+  /* Build the whole response header, then send it by one write()*/
+  /* Process header line*/
+  header_bytes = snprintf(response_header, BUFFER_SIZE, "%s %d %s\r\n",
+                          http_version, code, status);
+
+  /* Process header messages*/
+  for(i = 0; i < message_size && header_bytes < BUFFER_SIZE; i++) {
+    header_bytes += snprintf(response_header + header_bytes,
+                            BUFFER_SIZE - header_bytes, "%s: %s\r\n",
+                            messages[i].field, messages[i].data);
+  }
+  if (header_bytes + 2 >= BUFFER_SIZE) { /* Header does not fit in buffer*/
+    printf("[-] ERROR response header is too long.\n");
+    WriteAll(client_socket, RESPONSE_TOO_LONG, strlen(RESPONSE_TOO_LONG));
+    return FAILURE_RESULT;
+  }
+  strcpy(response_header + header_bytes, "\r\n"); /* End of header line*/
+  header_bytes += 2;
+
+  printf("[*] RESPONSE server response:\n%s", response_header);
+  if (WriteAll(client_socket, response_header, header_bytes) < 0) {
+    perror("[-] ERROR during sending response header to client");
+    return FAILURE_RESULT;
+  }
+
+  printf("[+] SUCCESS sending response header to client.\n");
+  return SUCCESS_RESULT;
+}
+
+/**
+ *  @brief  This sends a response without a body.
+ *  @param  client_socket  Request from the client socket.
+ *  @param  http_version  Request HTTP version.
+ *  @param  code  statue code number.
+ *  @return Return 0 if successful.
+ */
+int HttpdRespond(int client_socket, char* http_version, int code) {
+  return HttpdRespondBody(client_socket, http_version, code, NULL, 0, NULL, 0);
+}
+
+/**
+ *  @brief  This sends a response with header fields and a body.
+ *          Content-Length and Connection are set from the body, so
+ *          headers must not have them. Cache-Control is "no-store"
+ *          unless headers have it.
+ *          (eg. {{"Content-Type", "application/json"}}, "{}", 2)
+ *  @param  client_socket  Request from the client socket.
+ *  @param  http_version  Request HTTP version.
+ *  @param  code  statue code number.
+ *  @param  headers  The header fields, or NULL.
+ *  @param  header_count  The number of headers.
+ *  @param  body  The body, or NULL.
+ *  @param  body_length  Bytes of the body.
+ *  @return Return 0 if successful.
+ */
+int HttpdRespondBody(int client_socket, char* http_version, int code,
+                    httpd_message headers[], int header_count,
+                    char* body, size_t body_length) {
+  CorkSocket(client_socket, 1); /* Header and body in full segments*/
+  if (ResponseHeader(client_socket, http_version, code, NO_FILE, "", NULL,
+                    NULL, headers, header_count, body_length) != SUCCESS_RESULT) {
+    return FAILURE_RESULT;
+  }
+  if (body_length > 0 && WriteAll(client_socket, body, body_length) < 0) {
+    perror("[-] ERROR during sending response body to client");
+    return FAILURE_RESULT;
+  }
+  CorkSocket(client_socket, 0);
+  return SUCCESS_RESULT;
+}
+
+/**
+ *  @brief  This hands a large response body to a bulk transfer process.
+ *          The body of a response over BULK_RESPONSE_SIZE is streamed by a
+ *          forked process, so the worker goes back to accept() and a long
+ *          media download does not hold up the small requests behind it.
+ *          At most MAX_BULK_TRANSFERS run per worker; beyond that the
+ *          worker streams the body itself.
+ *          The bulk transfer process keeps only the client socket and the
+ *          file, so it never holds the server port after the server stops.
+ *  @param  server  The server.
+ *  @param  body_size  Bytes of the response body.
+ *  @return Return pid of the bulk transfer in the worker, 0 in the bulk
+ *          transfer process (bulk_transfers is set to -1), or -1 if the
+ *          worker has to send the body itself.
+ */
+static pid_t StartBulkTransfer(httpd_server* server, off_t body_size) {
+  pid_t bulk_pid;
+  int i;
+
+  /* Reap the finished bulk transfers*/
+  for (i = 0; i < bulk_transfers; i++) {
+    if (waitpid(bulk_pids[i], NULL, WNOHANG) != 0) {
+      bulk_pids[i--] = bulk_pids[--bulk_transfers];
+    }
+  }
+
+  if (body_size <= BULK_RESPONSE_SIZE ||
+      bulk_transfers >= MAX_BULK_TRANSFERS) {
+    return -1;
+  }
+
+  fflush(stdout); /* Do not copy buffered logs into the bulk transfer*/
+  bulk_pid = fork();
+  if (bulk_pid < 0) { /* Failed to fork, send the body in the worker*/
+    perror("[*] SKIP starting bulk transfer");
+    return -1;
+  } else if (bulk_pid == 0) { /* Bulk transfer process*/
+    sigset_t stop_mask;
+
+    /* SIGTERM ends a bulk transfer at once*/
+    signal(SIGTERM, SIG_DFL);
+    sigemptyset(&stop_mask);
+    sigaddset(&stop_mask, SIGTERM);
+    sigprocmask(SIG_UNBLOCK, &stop_mask, NULL);
+
+    close(server->server_socket);
+    if (server->trace_fd >= 0) {
+      close(server->trace_fd);
+    }
+    bulk_transfers = -1;
+    return 0;
+  }
+
+  bulk_pids[bulk_transfers++] = bulk_pid;
+  printf("[*] RESPONSE body handed to bulk transfer %d\n", (int) bulk_pid);
+  return bulk_pid;
+}
+
+/**
+ *  @brief  This stops the bulk transfers of a stopping worker.
+ *          Each gets SIGTERM and is waited for.
+ *  @return Return nothing
+ */
+static void StopBulkTransfers(void) {
+  int i;
+
+  for (i = 0; i < bulk_transfers; i++) {
+    kill(bulk_pids[i], SIGTERM);
+  }
+  for (i = 0; i < bulk_transfers; i++) {
+    while (waitpid(bulk_pids[i], NULL, 0) < 0 && errno == EINTR) {
+      /* Wait for the bulk transfer*/
+    }
+  }
+  bulk_transfers = 0;
+}
+
+/**
+ *  @brief  This logs the network state of a finished response.
+ *          The time spent by the server is printed next to the RTT,
+ *          congestion window, retransmits and estimated delivery rate
+ *          of the connection, so a slow client can be told apart from
+ *          slow server code.
+ *  @param  client_socket  Request from the client socket.
+ *  @param  start_time  The time the response started. (CLOCK_MONOTONIC)
+ *  @return Return nothing
+ */
+static void LogTCPInfo(int client_socket, struct timespec* start_time) {
+  struct timespec end_time;
+  double elapsed_ms;  /** Time spent sending the response*/
+
+  clock_gettime(CLOCK_MONOTONIC, &end_time);
+  elapsed_ms = (end_time.tv_sec - start_time->tv_sec) * 1000.0 +
+              (end_time.tv_nsec - start_time->tv_nsec) / 1000000.0;
+
+#ifdef __linux__
+  {
+    struct tcp_info info;
+    socklen_t info_length = sizeof(info);
+    double delivery_rate = 0; /** cwnd * mss / rtt, bytes per second*/
+
+    if (getsockopt(client_socket, IPPROTO_TCP, TCP_INFO,
+                  &info, &info_length) == 0) {
+      if (info.tcpi_rtt > 0) {
+        delivery_rate = (double) info.tcpi_snd_cwnd * info.tcpi_snd_mss *
+                        1000000.0 / info.tcpi_rtt;
+      }
+      printf("[*] TCP_INFO time %.3f ms, rtt %u/%u us, cwnd %u, "
+            "retrans %u, rate %.0f B/s\n",
+            elapsed_ms, info.tcpi_rtt, info.tcpi_rttvar, info.tcpi_snd_cwnd,
+            info.tcpi_total_retrans, delivery_rate);
+      return;
+    }
+  }
+#endif
+  printf("[*] TCP_INFO time %.3f ms\n", elapsed_ms);
+}
+
+/**
+ *  @brief  This writes the whole data to the client.
+ *          write() is repeated until every byte is accepted by the socket.
+ *  @param  client_socket  Request from the client socket.
+ *  @param  data  The data to send.
+ *  @param  length  The bytes of the data.
+ *  @return Return sent bytes, or -1 if write() failed.
+ */
+static ssize_t WriteAll(int client_socket, char* data, size_t length) {
+  size_t sent_size = 0;
+  ssize_t data_bytes;
+
+  while (sent_size < length) {
+    data_bytes = write(client_socket, data + sent_size, length - sent_size);
+    if (data_bytes < 0 && errno == EINTR) { /* Interrupted, write again*/
+      continue;
+    } else if (data_bytes < 0) {  /* Failed to write*/
+      return -1;
+    }
+    sent_size += data_bytes;
+  }
+
+  return sent_size;
+}
+
+/**
+ *  @brief  This discards the request body left unread after a response.
+ *          Closing a socket with unread data sends RST, which may drop
+ *          the response before the client reads it. The write side is
+ *          shut down first so the client sees the end of the response,
+ *          then up to DRAIN_LIMIT bytes are read until the client closes.
+ *  @param  client_socket  Request from the client socket.
+ *  @return Return nothing
+ */
+static void DrainRequest(int client_socket) {
+  char  buffer[BUFFER_SIZE];
+  struct timeval timeout = {DRAIN_TIMEOUT, 0};
+  size_t drained_bytes = 0;
+  ssize_t read_bytes;
+
+  shutdown(client_socket, SHUT_WR);
+  setsockopt(client_socket, SOL_SOCKET, SO_RCVTIMEO,
+            &timeout, sizeof(timeout));
+  while (drained_bytes < DRAIN_LIMIT) {
+    read_bytes = read(client_socket, buffer, BUFFER_SIZE);
+    if (read_bytes < 0 && errno == EINTR) { /* Interrupted, read again*/
+      continue;
+    } else if (read_bytes <= 0) { /* Closed by the client, or timed out*/
+      break;
+    }
+    drained_bytes += read_bytes;
+  }
+}
+
+/**
+ *  @brief  This sets the socket priority of a response by its body size.
+ *          Small responses are marked interactive and large ones bulk.
+ *          Only the band qdiscs (pfifo_fast, prio) map SO_PRIORITY to a
+ *          band, where a short page skips ahead of a media download.
+ *          fq_codel and fq, the default on most systems, ignore it.
+ *  @param  client_socket  Request from the client socket.
+ *  @param  body_size  Bytes of the response body.
+ *  @return Return nothing
+ */
+static void SetSendPriority(int client_socket, off_t body_size) {
+#ifdef SO_PRIORITY
+  int priority = (body_size <= SMALL_RESPONSE_SIZE) ?
+                PRIORITY_INTERACTIVE : PRIORITY_BULK;
+
+  if (setsockopt(client_socket, SOL_SOCKET, SO_PRIORITY,
+                &priority, sizeof(priority)) < 0) {
+    perror("[*] SKIP setting socket priority");  /* Optional feature*/
+  }
+#endif
+}
+
+/**
+ *  @brief  This corks or uncorks the client socket.
+ *          While corked, the header and the body are packed into full
+ *          segments, so a small response leaves in as few packets as
+ *          possible.
+ *  @param  client_socket  Request from the client socket.
+ *  @param  is_corked  1 to hold partial segments, 0 to send them.
+ *  @return Return nothing
+ */
+static void CorkSocket(int client_socket, int is_corked) {
+#if defined(TCP_CORK)
+  setsockopt(client_socket, IPPROTO_TCP, TCP_CORK,
+            &is_corked, sizeof(is_corked));
+#elif defined(TCP_NOPUSH)
+  setsockopt(client_socket, IPPROTO_TCP, TCP_NOPUSH,
+            &is_corked, sizeof(is_corked));
+#endif
+}
+
+/**
+ *  @brief  This routes the function that sends response body by content type.
+ *  @param  client_socket  Request from the client socket.
+ *  @param  buffer  The buffer to write response body.
+ *  @param  filesrc  The source of existing file.
+ *  @param  filetype  The content type of the file.
+ *  @param  file_fd  The opened descriptor of the file.
+ *  @param  file_stat  The stat of the file.
+ *  @return Return bytes of the response message.
+ */
+static off_t ResponseBody(int client_socket, char* buffer, char* filesrc,
+                    File_t filetype, int file_fd, struct stat* file_stat) {
+  off_t response_bytes = 0;
+  printf("Request {%s} by method #{%d}\n", filesrc, filetype);
+
+  /* Routing. Text and binary files are both sent as they are on disk*/
+  if (filetype == UNKNOWN_FILE ||
+      (HTML_FILE <= filetype && filetype <= PDF_FILE)) {
+    response_bytes = SendResponse(client_socket, buffer, filesrc,
+                                  file_fd, file_stat->st_size);
+  } else {
+    error("[-] ERROR routing error.");
+  }
+
+  printf("[+] SUCCESS sending response body to client.\n");
+  return response_bytes;
+}
+
+/**
+ *  @brief  This is HTTP response function.
+ *          Read the file and response to the client.
+ *          The file is sent byte for byte, so the body always matches
+ *          the Content-Length even for text with NUL bytes or no
+ *          trailing newline.
+ *  @param  client_socket Request from the client socket.
+ *  @param  buffer  The buffer to write response body.
+ *  @param  file_name The request file name.
+ *  @param  file_fd  The opened descriptor of the file.
+ *  @param  file_size  The file size by fstat().
+ *  @return Return bytes of the response message.
+ */
+static off_t SendResponse(int client_socket, char* buffer, char* file_name,
+                  int file_fd, off_t file_size) {
+  send_state state; /** Progress of the file transfer*/
+  off_t byte_sum = 0; /** Total response bytes*/
+  ssize_t data_bytes = 0; /** Bytes returned by SendFileChunk()*/
+
+  memset(buffer,0x00,BUFFER_SIZE);
+
+  state.file_fd = file_fd;
+  state.offset = 0;
+  state.file_size = file_size;
+  printf("%s: Total %lld bytes\n", file_name, (long long) state.file_size);
+
+  /* File send progress: state.offset/state.file_size(%) */
+  while (state.offset < state.file_size) {
+    data_bytes = SendFileChunk(client_socket, buffer, &state);
+    if (data_bytes == 0) { /* File shrank during the transfer*/
+      printf("[*] %s: truncated at %lld bytes\n",
+            file_name, (long long) state.offset);
+      break;
+    } else if (data_bytes < 0) {  /* Client is gone, end the response*/
+      printf("[*] %s: stopped at %lld bytes\n",
+            file_name, (long long) state.offset);
+      break;
+    }
+    byte_sum += data_bytes;
+  }
+
+  printf("[+] SendResponse input file_name: %s, %lld Bytes\n",
+        file_name, (long long) byte_sum);
+
+  printf("[+] SUCCESS sending response data to client.\n");
+  return byte_sum;
+}
+
+/**
+ *  @brief  This sends the next piece of a file to the client.
+ *          On Linux the piece goes from the page cache to the socket by
+ *          sendfile(), otherwise it is read at state->offset into buffer.
+ *          Only the bytes accepted by the socket are consumed, so a short
+ *          write is retried from the right offset on the next call.
+ *  @param  client_socket Request from the client socket.
+ *  @param  buffer  The buffer to read file data into.
+ *  @param  state  The send state of the file transfer.
+ *  @return Return sent bytes, 0 if the file ended before file_size, or -1
+ *          if the client closed the connection or the file cannot be read.
+ */
+static ssize_t SendFileChunk(int client_socket, char* buffer, send_state* state) {
+  ssize_t read_size,  /** Bytes returned by pread()*/
+          data_bytes; /** Bytes returned by write()*/
+  off_t remain_size = state->file_size - state->offset;
+
+#ifdef __linux__
+  if (remain_size > SENDFILE_CHUNK) {
+    remain_size = SENDFILE_CHUNK;
+  }
+
+  do {
+    /* sendfile() advances state->offset by the sent bytes*/
+    data_bytes = sendfile(client_socket, state->file_fd, &state->offset,
+                          (size_t) remain_size);
+  } while (data_bytes < 0 && errno == EINTR);
+  if (data_bytes >= 0) {
+    return data_bytes;
+  } else if (errno != EINVAL && errno != ENOSYS) { /* Failed to send*/
+    perror("[-] ERROR during sending file to client");
+    return -1;
+  }
+  /* sendfile() is not supported for this file, copy it by buffer*/
+  remain_size = state->file_size - state->offset;
+#endif
+
+  if (remain_size > BUFFER_SIZE) {
+    remain_size = BUFFER_SIZE;
+  }
+
+  do {
+    read_size = pread(state->file_fd, buffer, (size_t) remain_size,
+                      state->offset); /* read file*/
+  } while (read_size < 0 && errno == EINTR);
+  if (read_size < 0) { /* Failed to read file.*/
+    perror("[-] ERROR during reading file as binary");
+    return -1;
+  } else if (read_size == 0) { /* End of file before file_size*/
+    return 0;
+  }
+
+  do {
+    data_bytes = write(client_socket, buffer, (size_t) read_size); /* send file*/
+  } while (data_bytes < 0 && errno == EINTR);
+  if (data_bytes < 0) { /* Failed to write, EPIPE or ECONNRESET*/
+    perror("[-] ERROR during sending data to client");
+    return -1;
+  }
+
+  state->offset += data_bytes;
+  return data_bytes;
+}
@@ -0,0 +1,114 @@
+/**
+ *  @file   httpd.h
+ *  @brief  The embeddable web server library (libhttpd).
+ *          A program creates a server on a port, mounts the directory to
+ *          serve, registers handlers for its own routes and runs the
+ *          workers until it stops the server.
+ *          Several servers may be created in one program. Each HttpdRun()
+ *          supervises its own workers, and a worker process serves only
+ *          the server it was started for.
+ *  @author Seunghyun Kim
+ */
+#ifndef HTTPD_H
+#define HTTPD_H
+
+#include <signal.h>
+#include <sys/types.h>
+
+/* Success and error value*/
+#define HTTPD_SUCCESS 0
+#define HTTPD_FAILURE -1
+
+#define HTTPD_MAX_ROUTES 32 /* Routes per server*/
+
+/**
+ *  @brief  The http request header line message.
+ *          Struct contains "action" "location" "http_version"
+ *          (eg. GET /index.html HTTP/1.1)
+ */
+typedef struct httpd_request_line {
+  char* action; /** request message*/
+  char* location; /** request location*/
+  char* http_version; /** HTTP version*/
+} httpd_request_line;
+
+/**
+ *  @brief  The http body message struct.
+ *          Struct contains "field":"data"
+ *          (eg. Host: localhost:10000)
+ */
+typedef struct httpd_message {
+  char* field;  /** Field name*/
+  char* data; /** Field value*/
+} httpd_message;
+
+/**
+ *  @brief  The message body struct.
+ *          Struct contains the part of the message body that was read
+ *          together with the request header. The rest is still in the
+ *          client socket.
+ */
+typedef struct httpd_content {
+  char* data; /** Body bytes read with the header*/
+  size_t length;  /** Number of bytes at data*/
+} httpd_content;
+
+/**
+ *  @brief  The route handler. It runs in a worker process and sends the
+ *          whole response to the client socket.
+ *          (eg. HttpdRespondBody() with the body and header fields)
+ *          arg is the pointer given to HttpdRoute().
+ *  @return Return 0 if successful, the connection is closed afterwards.
+ */
+typedef int (*httpd_handler)(int client_socket,
+                            httpd_request_line* req_header_line,
+                            httpd_message request_body[], int request_body_line,
+                            httpd_content* content, void* arg);
+
+/**
+ *  @brief  The route struct.
+ *          Struct contains "action" "location" and the handler.
+ */
+typedef struct httpd_route {
+  char* action; /** request message*/
+  char* location; /** request location*/
+  httpd_handler handler;  /** Handler of the matching requests*/
+  void* arg;  /** Passed to the handler as is*/
+} httpd_route;
+
+/**
+ *  @brief  The server struct. Create it with HttpdCreate().
+ */
+typedef struct httpd_server {
+  int server_socket;  /** The listening server socket*/
+  int docroot_fd; /** The document root directory*/
+  int trace_fd; /** The span export file descriptor, or -1 if disabled*/
+  httpd_route routes[HTTPD_MAX_ROUTES]; /** Registered routes*/
+  int route_count;  /** Number of registered routes*/
+  volatile sig_atomic_t stopping; /** Set by HttpdStop()*/
+  volatile unsigned long* worker_loads; /** Requests served per worker*/
+} httpd_server;
+
+httpd_server* HttpdCreate(int portno);
+int HttpdMount(httpd_server* server, char* docroot);
+int HttpdRoute(httpd_server* server, char* action, char* location,
+              httpd_handler handler, void* arg);
+int HttpdTrace(httpd_server* server, char* trace_path);
+int HttpdRun(httpd_server* server);
+void HttpdStop(httpd_server* server);
+void HttpdDestroy(httpd_server* server);
+
+char* HttpdGetHeader(httpd_message request_body[], int request_body_line,
+                    char* field);
+ssize_t HttpdReadContent(int client_socket, httpd_content* content,
+                        char* buffer, size_t length);
+int HttpdRespond(int client_socket, char* http_version, int code);
+int HttpdRespondBody(int client_socket, char* http_version, int code,
+                    httpd_message headers[], int header_count,
+                    char* body, size_t body_length);
+int HttpdUploadHandler(int client_socket, httpd_request_line* req_header_line,
+                      httpd_message request_body[], int request_body_line,
+                      httpd_content* content, void* arg);
+char* HttpdTraceParent(void);
+
+#endif